@@ -2,6 +2,22 @@
 precision highp float;
 
 #define AA 1
+
+// built again with DOUBLE_PRECISION or DF64_PRECISION defined for deep
+// zooms, where the camera, the zoom and the positions inside the map loop
+// are doubles, or emulated ones made of two floats. Distances and
+// directions stay floats, they are relative to the footprint
+#ifdef DOUBLE_PRECISION
+#define real double
+#define pos3 dvec3
+#else
+#define real float
+#ifdef DF64_PRECISION
+#define pos3 df64v3
+#else
+#define pos3 vec3
+#endif
+#endif
 //#define STEPLENGTH .25
 #define STEPLENGTH .25
 #define STEPCOUNT 128
@@ -20,15 +36,136 @@ uniform vec3 diffc3;
 
 uniform vec2 resolution;
 
-uniform float zoomLevel;
+uniform real zoomLevel;
 uniform float startOffset;
 
-layout(r32f) uniform restrict readonly image2D inputDepthBuffer;
-layout(r32f) uniform restrict writeonly image2D outputDepthBuffer;
+// built with LAYERED_FACES, one draw marches every face of a cube layer,
+// the geometry shader routing each copy of the plane to its own `gl_Layer`.
+// The per face images then come as whole arrays
+#ifdef LAYERED_FACES
+#define faceImage image2DArray
+#define faceCoord(c) ivec3(c, gl_Layer)
+#else
+#define faceImage image2D
+#define faceCoord(c) (c)
+#endif
+
+// the depth recorded for rays which escape the fractal entirely
+#define SKY_DEPTH 1e20
+
+// built with PACKED_DEPTH, the depth images are 16 bit signed normalized,
+// holding log2 of the world distances over `depthLogRange`. The sign, the 0
+// of pixels resolved in front and the sky all carry over, and distances
+// round towards the eye so handed over rays never start past a surface
+#ifdef PACKED_DEPTH
+#define depthFormat r16_snorm
+uniform vec2 depthLogRange;
+
+float encodeDepth(float d)
+{
+  float m = abs(d);
+  if(m == 0. || m >= SKY_DEPTH*.5)
+    return sign(d);
+  float e = (log2(m) - depthLogRange.x)/(depthLogRange.y - depthLogRange.x);
+  return sign(d)*clamp(floor(e*32767.), 1., 32766.)/32767.;
+}
 
-uniform vec3 camOrigin;
+float decodeDepth(float e)
+{
+  float a = abs(e);
+  if(a == 0. || a >= 1.)
+    return sign(e)*(a == 0. ? 0. : SKY_DEPTH);
+  return sign(e)*exp2(mix(depthLogRange.x, depthLogRange.y, a));
+}
+#else
+#define depthFormat r32f
+#define encodeDepth(d) (d)
+#define decodeDepth(e) (e)
+#endif
+
+layout(depthFormat) uniform restrict readonly faceImage inputDepthBuffer;
+layout(depthFormat) uniform restrict writeonly faceImage outputDepthBuffer;
+// set when `outputDepthBuffer` is bound, so the march distance of every pixel
+// gets recorded for reprojecting the layer later on
+uniform bool writeDepth;
+// when set, each ray picks up where the pass before handed it over in
+// `inputDepthBuffer`, and is handed over in turn past `bandFar` (world
+// units). Pixels resolved by an earlier pass are left alone, marked 0
+uniform bool continueRays;
+uniform float bandFar;
+// the most input texels along each axis a pixel takes over, when the
+// layer before was marched finer
+#define MAX_HANDOVER_RATIO 4
+
+// statistics gathered over a whole layer while `collectStats` is set
+uniform bool collectStats;
+layout(std430, binding = 0) buffer layerStats {
+  // bits of the smallest hit distance, positive floats sort like uints
+  uint nearestDepth;
+  // pixels left for the layers after this one
+  uint unresolvedCount;
+  // steps marched, for fitting the layers to even work
+  uint stepCount;
+};
+// the indirect draws of the onion layer passes, see MarchingManager::redraw.
+// A pass that leaves pixels unresolved gives pass `nextPass` its instance,
+// the ones after a pass that resolved everything never get drawn
+struct DrawCommand {
+  uint count;
+  uint instanceCount;
+  uint first;
+  uint baseInstance;
+};
+layout(std430, binding = 1) buffer layerPasses {
+  DrawCommand passes[];
+};
+uniform int nextPass;
+
+// positions come in relative to the camera, only the double precision
+// build gets it in world units
+#ifdef DOUBLE_PRECISION
+uniform dvec3 camOrigin;
+#endif
+// the camera in fractal space, worked out in doubles, and what rounding
+// that to floats lost
+uniform vec3 originHi;
+uniform vec3 originLo;
+// center of the fractal's bounds, in world units from the camera
+uniform vec3 boundsCenter;
 // camera transformation
 uniform mat4 view;
+#ifdef LAYERED_FACES
+// forward and up of each face, in the order of texture_dirs
+const vec3 faceForward[6] = vec3[6](vec3(0, 0, 1), vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, 1, 0));
+const vec3 faceUp[6] = vec3[6](vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, -1), vec3(0, 0, 1));
+
+// what `view` holds for a face, as glm::lookAt builds it
+mat4 faceView(int face)
+{
+  vec3 f = faceForward[face];
+  vec3 s = normalize(cross(f, faceUp[face]));
+  vec3 u = cross(s, f);
+  return mat4(vec4(s, 0.), vec4(u, 0.), vec4(-f, 0.), vec4(0., 0., 0., 1.));
+}
+#endif
+
+// when set, `resolution` spans an equal area octahedral map of every
+// direction, rather than a pinhole view through `view`
+uniform bool octahedral;
+
+// the direction a point of the unit square stands for in the equal area
+// octahedral map, after Clarberg. Every pixel covers the same solid angle
+vec3 equalAreaDirection(vec2 p)
+{
+  vec2 uv = 2.*p - 1.;
+  vec2 a = abs(uv);
+  float signedDistance = 1. - (a.x + a.y);
+  float r = 1. - abs(signedDistance);
+  float phi = (r == 0. ? 1. : (a.y - a.x)/r + 1.)*3.14159265/4.;
+  float z = signedDistance < 0. ? r*r - 1. : 1. - r*r;
+  vec2 s = vec2(uv.x < 0. ? -1. : 1., uv.y < 0. ? -1. : 1.);
+  return vec3(s*vec2(cos(phi), sin(phi))*r*sqrt(max(2. - r*r, 0.)), z);
+}
 
 uniform int intersectStartStep;
 
@@ -50,17 +187,199 @@ uniform bool movingJulia;
 uniform bool exhaust;
 uniform bool doFog;
 
+// foveated marching: the framebuffer is a warped, reduced version of
+// `resolution`, with full pixel density only around `gazePoint`
+uniform bool foveated;
+uniform vec2 bufferResolution;
+uniform vec2 gazePoint;
+uniform vec3 gazeDir;
+uniform float foveaDensity;
+// fraction of the step budget lost, and map iterations dropped, per radian
+// away from `gazeDir`
+uniform float foveaStepFalloff;
+uniform float foveaIterFalloff;
+
+// guide pass for edge aware upsampling: only the hit depth gets written
+// out, marched with `guideIterDrop` fewer map iterations
+uniform bool depthOnly;
+uniform int guideIterDrop;
+
+// interleaved marching: only the pixels in slot `interleavePhase` of a 2x2
+// pattern (or checkerboard, for 2) get marched this frame
+uniform int interleave;
+uniform int interleavePhase;
+
+// progressive refinement of still frames: a subpixel offset per sample,
+// extra map iterations, and a finer shadow march
+uniform vec2 jitter;
+uniform int iterBoost;
+uniform int shadowSteps;
+uniform float shadowSharpness;
+
+// temporal seeding: the nearest hit of the last frame landing on each pixel,
+// as uint bits, rays start at `seedFraction` of the nearest around them
+layout(r32ui) uniform restrict readonly uimage2D seedBuffer;
+uniform bool seeded;
+uniform float seedFraction;
+// seeds around a pixel spreading over more than this ratio of distances
+// mark a silhouette
+#define SEED_MAX_SPREAD 1.25
+
+// deferred shading: the march can also store its surface terms, so edits
+// to the colors only need a shading pass rather than a whole new march
+uniform bool writeGBuffer;
+uniform bool shadeOnly;
+// normal and shadow, then the orbit trap weights and occlusion
+layout(rgba16f) uniform restrict faceImage gbufferNormal;
+layout(rgba16f) uniform restrict faceImage gbufferMaterial;
+layout(depthFormat) uniform restrict readonly faceImage gbufferDepth;
+
+// map iterations past the ones that resolve the pixel footprint
+uniform float footprintBias;
+// footprints never call for more than this
+const int MAX_FOOTPRINT_ITER = 32;
+
+// march budgets of the current pixel
+int stepBudget = 0;
+int iterDrop = 0;
+// fractal space width of what the current map call samples
+float sampleWidth = 0.;
+
 out vec4 color;
 
 float rand(vec2 co){
   return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
 }
 
-struct expanded_float {
-  int exponent;
-  int mantissa;
+#ifdef DF64_PRECISION
+// double-float arithmetic, for GPUs that run doubles at a fraction of the
+// float rate. A value is the unevaluated sum of two floats in a vec2, the
+// rounded value and what rounding it lost, together about 48 bits of
+// mantissa. `precise` keeps the compiler from simplifying the error terms
+// away or fusing them into multiply-adds
+
+// a + b exactly, as the rounded sum and its error
+vec2 twoSum(in float a, in float b)
+{
+  precise float s = a + b;
+  precise float v = s - a;
+  precise float e = (a - (s - v)) + (b - v);
+  return vec2(s, e);
+}
+
+// the same, for |a| >= |b|
+vec2 quickTwoSum(in float a, in float b)
+{
+  precise float s = a + b;
+  precise float e = b - (s - a);
+  return vec2(s, e);
+}
+
+// a*b exactly, from halves of both whose products need no rounding
+vec2 twoProd(in float a, in float b)
+{
+  precise float p = a*b;
+  precise float ta = 4097.*a;
+  precise float ah = ta - (ta - a);
+  precise float al = a - ah;
+  precise float tb = 4097.*b;
+  precise float bh = tb - (tb - b);
+  precise float bl = b - bh;
+  precise float e = ((ah*bh - p) + ah*bl + al*bh) + al*bl;
+  return vec2(p, e);
+}
+
+vec2 dfAdd(in vec2 a, in vec2 b)
+{
+  vec2 s = twoSum(a.x, b.x);
+  precise float e = s.y + (a.y + b.y);
+  return quickTwoSum(s.x, e);
+}
+
+vec2 dfAdd(in vec2 a, in float b)
+{
+  vec2 s = twoSum(a.x, b);
+  precise float e = s.y + a.y;
+  return quickTwoSum(s.x, e);
+}
+
+vec2 dfSub(in vec2 a, in vec2 b)
+{
+  return dfAdd(a, -b);
+}
+
+vec2 dfMul(in vec2 a, in vec2 b)
+{
+  vec2 p = twoProd(a.x, b.x);
+  precise float e = p.y + (a.x*b.y + a.y*b.x);
+  return quickTwoSum(p.x, e);
+}
+
+vec2 dfMul(in vec2 a, in float b)
+{
+  vec2 p = twoProd(a.x, b);
+  precise float e = p.y + a.y*b;
+  return quickTwoSum(p.x, e);
+}
+
+// the float estimate, refined by a Newton step
+vec2 dfInverseSqrt(in vec2 a)
+{
+  float y = inversesqrt(a.x);
+  vec2 r = dfSub(vec2(1., 0.), dfMul(a, twoProd(y, y)));
+  return dfAdd(dfMul(r, .5*y), y);
+}
+
+vec2 dfSqrt(in vec2 a)
+{
+  return a.x > 0. ? dfMul(a, dfInverseSqrt(a)) : vec2(0.);
+}
+
+struct df64v3 {
+  vec2 x;
+  vec2 y;
+  vec2 z;
 };
 
+vec3 dfFloat(in df64v3 a)
+{
+  return vec3(a.x.x + a.x.y, a.y.x + a.y.y, a.z.x + a.z.y);
+}
+#endif
+
+// the camera in fractal space, and points along rays from it
+#ifdef DOUBLE_PRECISION
+dvec3 fractalOrigin()
+{
+  return camOrigin/zoomLevel;
+}
+
+dvec3 offsetPos(in dvec3 p, in vec3 d)
+{
+  return p + dvec3(d);
+}
+#elif defined(DF64_PRECISION)
+df64v3 fractalOrigin()
+{
+  return df64v3(vec2(originHi.x, originLo.x), vec2(originHi.y, originLo.y), vec2(originHi.z, originLo.z));
+}
+
+df64v3 offsetPos(in df64v3 p, in vec3 d)
+{
+  return df64v3(dfAdd(p.x, d.x), dfAdd(p.y, d.y), dfAdd(p.z, d.z));
+}
+#else
+vec3 fractalOrigin()
+{
+  return originHi;
+}
+
+vec3 offsetPos(in vec3 p, in vec3 d)
+{
+  return p + d;
+}
+#endif
+
 // a culling bounds detector for a sphere
 // Arguments:
 // `sph.xyz`: Center of the sphere
@@ -85,91 +404,319 @@ vec2 isphere( in vec4 sph, in vec3 ro, in vec3 rd )
   return -b + vec2(-h,h);
 }
 
+// the power of `w`, less the point it was raised from
+#ifdef DOUBLE_PRECISION
+dvec3 bulbPower(in dvec3 w)
+{
+  // there are no double trigonometrics, but the usual power of 8 has a
+  // polynomial form
+  if(modulo == 8)
+  {
+    double x = w.x; double x2 = x*x; double x4 = x2*x2;
+    double y = w.y; double y2 = y*y; double y4 = y2*y2;
+    double z = w.z; double z2 = z*z; double z4 = z2*z2;
+    
+    double k3 = x2 + z2;
+    double k2 = inversesqrt( k3*k3*k3*k3*k3*k3*k3 );
+    double k1 = x4 + y4 + z4 - 6.0*y2*z2 - 6.0*x2*y2 + 2.0*z2*x2;
+    double k4 = x2 - y2 + z2;
+    
+    return dvec3(
+      64.0*x*y*z*(x2-z2)*k4*(x4-6.0*x2*z2+z4)*k1*k2,
+      -16.0*y2*k3*k4*k4 + k1*k1,
+      -8.0*y*k4*(x4*x4 - 28.0*x4*x2*z2 + 70.0*x4*z4 - 28.0*x2*z2*z4 + z4*z4)*k1*k2 );
+  }
+  
+  // other powers keep the magnitude precise, and take the angles in floats
+  double r = length(w);
+  float b = modulo*acos( float(w.y/r) );
+  float a = modulo*atan( float(w.x), float(w.z) );
+  double rn = 1.0;
+  for(int i = 0; i < modulo; i++)
+    rn *= r;
+  return rn * dvec3( sin(b)*sin(a), cos(b), sin(b)*cos(a) );
+}
+#endif
+
+#ifdef DF64_PRECISION
+// the same polynomial in double-floats
+df64v3 bulbPower(in df64v3 w)
+{
+  vec2 x = w.x; vec2 x2 = dfMul(x, x); vec2 x4 = dfMul(x2, x2);
+  vec2 y = w.y; vec2 y2 = dfMul(y, y); vec2 y4 = dfMul(y2, y2);
+  vec2 z = w.z; vec2 z2 = dfMul(z, z); vec2 z4 = dfMul(z2, z2);
+  
+  if(modulo == 8)
+  {
+    vec2 x2z2 = dfMul(x2, z2);
+    vec2 k3 = dfAdd(x2, z2);
+    vec2 k3_3 = dfMul(dfMul(k3, k3), k3);
+    vec2 k2 = dfInverseSqrt(dfMul(dfMul(k3_3, k3_3), k3));
+    vec2 k1 = dfAdd(dfAdd(x4, y4), z4);
+    k1 = dfSub(k1, dfMul(dfAdd(dfMul(y2, z2), dfMul(x2, y2)), 6.));
+    k1 = dfAdd(k1, dfMul(x2z2, 2.));
+    vec2 k4 = dfSub(k3, y2);
+    vec2 k12 = dfMul(k1, k2);
+    
+    vec2 rx = dfMul(dfMul(dfMul(x, y), z), 64.);
+    rx = dfMul(dfMul(rx, dfSub(x2, z2)), k4);
+    rx = dfMul(dfMul(rx, dfAdd(dfSub(x4, dfMul(x2z2, 6.)), z4)), k12);
+    
+    vec2 ry = dfAdd(dfMul(dfMul(dfMul(y2, k3), dfMul(k4, k4)), -16.), dfMul(k1, k1));
+    
+    vec2 rz = dfAdd(dfMul(x4, x4), dfMul(z4, z4));
+    rz = dfSub(rz, dfMul(dfAdd(dfMul(x4, x2z2), dfMul(x2z2, z4)), 28.));
+    rz = dfAdd(rz, dfMul(dfMul(x4, z4), 70.));
+    rz = dfMul(dfMul(dfMul(dfMul(y, k4), -8.), rz), k12);
+    
+    return df64v3(rx, ry, rz);
+  }
+  
+  vec2 r = dfSqrt(dfAdd(dfAdd(x2, y2), z2));
+  float b = modulo*acos( y.x/r.x );
+  float a = modulo*atan( x.x, z.x );
+  vec2 rn = vec2(1., 0.);
+  for(int i = 0; i < modulo; i++)
+    rn = dfMul(rn, r);
+  return df64v3(dfMul(rn, sin(b)*sin(a)), dfMul(rn, cos(b)), dfMul(rn, sin(b)*cos(a)));
+}
+#endif
+
+vec3 bulbPower(in vec3 w)
+{
+  float r = length(w);
+  float b = modulo*acos( w.y/r);
+  float a = modulo*atan( w.x, w.z );
+  return pow(r,modulo) * vec3( sin(b)*sin(a), cos(b), sin(b)*cos(a) );
+}
+
+vec3 juliaPosition()
+{
+  if(movingJulia)
+    return vec3(.4*cos(.25*time+1.), .2*sin(time+.2)+.7*sin(time*.33+0.5), .7*cos(time*.33+.05));
+  return juliaPoint;
+}
+
 // The "map" function for our fractal
 // Arguments:
 // `p`: The point to sample
 // Return:
 // `resColor`:  the color to render at this sample
 // `out`:       the "magnitude" at this point
-float map(in int mapsteps, in vec3 p, out vec4 resColor )
+#ifdef DF64_PRECISION
+// `dz` times the sample width past which floats tell neighbouring samples
+// apart well enough, see map
+#define DF64_HANDOFF 1e-4
+
+float map(in int mapsteps, in df64v3 p, out vec4 resColor )
+{
+  vec3 jp = juliaPosition();
+  float f = clamp(juliaFactor, 0., 1.);
+  // mix(p, jp, f), kept as precise as `p`
+  df64v3 c = df64v3(dfAdd(dfMul(p.x, 1. - f), jp.x*f), dfAdd(dfMul(p.y, 1. - f), jp.y*f), dfAdd(dfMul(p.z, 1. - f), jp.z*f));
+  
+  df64v3 w = p;
+  vec3 wf = dfFloat(w);
+  float m = dot(wf,wf);
+  
+  vec4 trap = vec4(abs(wf),m);
+  float dz = startOffset;
+  int maxMapIter = mapIterCount;
+  maxMapIter = max(max(mapsteps,maxMapIter) - iterDrop, 1);
+  
+  // `dz` is how far apart the iterations have pushed samples that started
+  // `sampleWidth` apart. Only the first iterations, while that is still
+  // below what floats resolve, need double-floats, the rest lose nothing
+  // the image shows in floats
+  int i = 0;
+  for( ; i<maxMapIter && dz*sampleWidth<DF64_HANDOFF; i++ )
+  {
+    dz = modulo*pow(sqrt(m),modulo-1.)*dz + 1.0;
+    df64v3 pw = bulbPower(w);
+    w = df64v3(dfAdd(c.x, pw.x), dfAdd(c.y, pw.y), dfAdd(c.z, pw.z));
+    wf = dfFloat(w);
+    trap = min( trap, vec4(abs(wf), m) );
+    m = dot(wf,wf);
+    if( m > modulo*modulo )
+      break;
+  }
+  
+  vec3 cf = dfFloat(c);
+  for( ; i<maxMapIter && m <= modulo*modulo; i++ )
+  {
+    dz = modulo*pow(sqrt(m),modulo-1.)*dz + 1.0;
+    wf = cf + bulbPower(wf);
+    trap = min( trap, vec4(abs(wf), m) );
+    m = dot(wf,wf);
+  }
+  
+  resColor = vec4(m,trap.yzw);
+  
+  return 0.25*log(m)*sqrt(m)/dz;
+}
+#else
+float map(in int mapsteps, in pos3 p, out vec4 resColor )
 {
 
-  vec3 w = p;
-  float m = dot(w,w);
+  pos3 w = p;
+  real m = dot(w,w);
 
-  vec4 trap = vec4(abs(w),m);
+  vec4 trap = vec4(abs(vec3(w)),float(m));
   float dz = startOffset;
   int maxMapIter = mapIterCount;
-  maxMapIter = max(mapsteps,maxMapIter);
+  maxMapIter = max(max(mapsteps,maxMapIter) - iterDrop, 1);
+  
+  //julia bulb
+  vec3 jp = juliaPosition();
   
   for( int i=0; i<maxMapIter; i++ )
   {
-	//julia bulb
-	
-	vec3 jp = juliaPoint;
-	if(movingJulia)
-	{
-	  jp = vec3(.4*cos(.25*time+1.), .2*sin(time+.2)+.7*sin(time*.33+0.5), .7*cos(time*.33+.05));
-	}
-    dz = modulo*pow(sqrt(m),modulo-1.)*dz + 1.0;
+    dz = modulo*pow(float(sqrt(m)),modulo-1.)*dz + 1.0;
     //dz = 8.0*pow(m,3.5)*dz + 1.0;
 
-    float r = length(w);
-    float b = modulo*acos( w.y/r);
-    float a = modulo*atan( w.x, w.z );
-    w = mix(p, jp, clamp(juliaFactor, 0., 1.)) + pow(r,modulo) * vec3( sin(b)*sin(a), cos(b), sin(b)*cos(a) );
+    w = mix(p, pos3(jp), real(clamp(juliaFactor, 0., 1.))) + bulbPower(w);
 
-    trap = min( trap, vec4(abs(w), m) );
+    trap = min( trap, vec4(abs(vec3(w)), float(m)) );
 
     m = dot(w,w);
     if( m > modulo*modulo )
       break;
   }
 
-  resColor = vec4(m,trap.yzw);
+  float fm = float(m);
+  resColor = vec4(fm,trap.yzw);
 
-  return 0.25*log(m)*sqrt(m)/dz;
+  return 0.25*log(fm)*sqrt(fm)/dz;
+
+}
+#endif
+
+// map iterations that resolve detail down to the width of the pixel cone
+// `t` along a ray, `t` in world units. Every iteration resolves detail
+// about `modulo` times finer than the one before
+int footprintIterations(in float px, in float t)
+{
+  float width = max(px*t/float(zoomLevel), 1e-30);
+  float n = -log(width)/log(max(float(modulo), 2.)) + footprintBias;
+  return clamp(int(ceil(n)), 1, MAX_FOOTPRINT_ITER);
+}
 
+// where a ray may safely start, from the seeds around its pixel. Pixels the
+// last frame didn't land near get marched in full, and so do the ones on a
+// silhouette, where a surface in front may have just come into view
+float seedStart(in ivec2 coord)
+{
+  ivec2 last = imageSize(seedBuffer) - 1;
+  uint nearest = 0xFFFFFFFFu, farthest = 0u;
+  for(int j = -1; j <= 1; j++)
+    for(int i = -1; i <= 1; i++)
+    {
+      uint s = imageLoad(seedBuffer, clamp(coord + ivec2(i, j), ivec2(0), last)).r;
+      if(s == 0xFFFFFFFFu)
+        continue;
+      nearest = min(nearest, s);
+      farthest = max(farthest, s);
+    }
+  if(nearest == 0xFFFFFFFFu || uintBitsToFloat(farthest) > uintBitsToFloat(nearest)*SEED_MAX_SPREAD)
+    return 0.;
+  return uintBitsToFloat(nearest)*seedFraction;
 }
 
-float intersect( in vec3 ro, in vec3 rd, out vec4 rescol, in float px, in ivec2 coord, out int g)
+// `origin` in fractal space
+float intersect( in pos3 origin, in vec3 rd, out vec4 rescol, in float px, in ivec2 coord, out int g)
 {
   float res = -1.0;
 
+  // the pass before may have been finer, this pixel then takes over every
+  // one of its texels under it, from the nearest of them. Only once all of
+  // them resolved is nothing left to it
+  float handedOver = 0.;
+  if(continueRays)
+  {
+    vec2 ratio = vec2(imageSize(inputDepthBuffer).xy)/vec2(imageSize(outputDepthBuffer).xy);
+    ivec2 first = ivec2(floor(vec2(coord)*ratio));
+    ivec2 last = min(max(ivec2(ceil(vec2(coord + 1)*ratio)), first + 1), first + MAX_HANDOVER_RATIO) - 1;
+    last = min(last, imageSize(inputDepthBuffer).xy - 1);
+    bool open = false;
+    handedOver = 1e30;
+    for(int y = first.y; y <= last.y; y++)
+      for(int x = first.x; x <= last.x; x++)
+      {
+        float d = decodeDepth(imageLoad(inputDepthBuffer, faceCoord(ivec2(x, y))).r);
+        if(d < 0.)
+        {
+          open = true;
+          handedOver = min(handedOver, -d);
+        }
+      }
+    if(!open)
+    {
+      // resolved by a pass in front
+      if(writeDepth)
+        imageStore(outputDepthBuffer, faceCoord(coord), vec4(0.));
+      discard;
+    }
+  }
+
   // bounding sphere
-  vec2 dis = isphere( vec4(0.0,0.0,0.0,1.25*zoomLevel), ro, rd );
+  vec2 dis = isphere( vec4(boundsCenter,1.25*float(zoomLevel)), vec3(0.0), rd );
   if( dis.y<0.0 )
+  {
+    if(writeDepth)
+      imageStore(outputDepthBuffer, faceCoord(coord), vec4(encodeDepth(SKY_DEPTH)));
     return -1.0;
+  }
   dis.x = max( dis.x, 0.0 );
-  dis.y = min( dis.y, 10.0*zoomLevel );
+  dis.y = min( dis.y, 10.0*float(zoomLevel) );
 
   // raymarch fractal distance field
   vec4 trap;
   int i;
 
   float t = dis.x;
+  if(seeded)
+    t = max(t, seedStart(coord));
+  t = max(t, handedOver);
+  float bandEnd = bandFar > 0. ? bandFar : 1e30;
 
-  for( i=0; i<intersectStepCount; i++ )
+  float h = 0., th = 0.;
+  for( i=0; i<stepBudget; i++ )
   {
-    vec3 pos = (ro + rd*t)/zoomLevel; //when i==0 pos is on the surface!?!?!
+    pos3 pos = offsetPos(origin, rd*(t/float(zoomLevel))); //when i==0 pos is on the surface!?!?!
 
-    float th = intersectThreshold*px*t;
+    // in fractal space, like the distances it is compared to
+    sampleWidth = px*t/float(zoomLevel);
+    th = intersectThreshold*sampleWidth;
 
-    int imp = int((4*(2 + log(zoomLevel)) - 8*t));
+    // fewer iterations the wider the pixel is where it samples
+    int imp = footprintIterations(px, t);
     g = imp;
 
-    float h = map(imp, pos, trap );
-    if( t>dis.y || h<th ) 
+    h = map(imp, pos, trap );
+    if( t>dis.y || h<th || t>bandEnd ) 
 		break;
-    t += zoomLevel*intersectStepFactor*h;
+    t += float(zoomLevel)*intersectStepFactor*h;
   }
+  if(collectStats)
+    atomicAdd(stepCount, uint(i));
 
   // this also trips if a ray goes parallel to an edge, causing
   // odd borders
   // hrmmph
 
-  if ( i >= intersectStepCount && !exhaust) // Leave some for the next step
+  // past the band, the next pass goes on from here
+  bool handOver = t>bandEnd && t<=dis.y && h>=th;
+  if ( (i >= stepBudget || handOver) && !exhaust) // Leave some for the next step
   {
+    // negative depths mark how far an unresolved ray got
+    if(writeDepth)
+      imageStore(outputDepthBuffer, faceCoord(coord), vec4(encodeDepth(-t)));
+    if(collectStats)
+    {
+      atomicAdd(unresolvedCount, 1u);
+      if(nextPass >= 0)
+        passes[nextPass].instanceCount = 1u;
+    }
     discard;
   }
   else if( t<dis.y ) // Either a hit, or enough distance traveled
@@ -178,17 +725,28 @@ float intersect( in vec3 ro, in vec3 rd, out vec4 rescol, in float px, in ivec2
     res = t;
   }
 
+  if(writeDepth)
+  {
+    imageStore(outputDepthBuffer, faceCoord(coord), vec4(encodeDepth(res < 0. ? SKY_DEPTH : res)));
+    if(res > 0. && collectStats)
+      atomicMin(nearestDepth, floatBitsToUint(res));
+  }
+
   return res;
 }
 
-float softshadow( in vec3 ro, in vec3 rd, in float k )
+// `ro` in fractal space, `hit` the world space distance the pixel cone
+// travelled to reach it
+float softshadow( in pos3 ro, in vec3 rd, in float k, in float px, in float hit )
 {
   float res = 1.0;
   float t = 0.0;
-  for( int i=0; i<64; i++ )
+  for( int i=0; i<shadowSteps; i++ )
   {
     vec4 kk;
-    float h = map(mapIterCount,ro + rd*t, kk);
+    // the cone keeps widening along the shadow ray
+    sampleWidth = px*(hit + t*float(zoomLevel))/float(zoomLevel);
+    float h = map(footprintIterations(px, hit + t*float(zoomLevel)),offsetPos(ro, rd*t), kk);
     res = min( res, k*h/t );
     if( res<0.001 ) break;
     t += clamp( h, 0.01, 0.2 );
@@ -196,15 +754,16 @@ float softshadow( in vec3 ro, in vec3 rd, in float k )
   return clamp( res, 0.0, 1.0 );
 }
 
-vec3 calcNormal( in int maplvl, in vec3 pos, in float t, in float px )
+vec3 calcNormal( in int maplvl, in pos3 pos, in float t, in float px )
 {
 //  return vec3(1.0, 0.0, 0.0);
   vec4 tmp;
-  vec2 eps = vec2( 0.25*px/zoomLevel, 0.0 );
+  vec2 eps = vec2( 0.25*px/float(zoomLevel), 0.0 );
+  sampleWidth = eps.x;
   return normalize( vec3(
-        map(maplvl,pos+eps.xyy,tmp) - map(maplvl,pos-eps.xyy,tmp),
-        map(maplvl,pos+eps.yxy,tmp) - map(maplvl,pos-eps.yxy,tmp),
-        map(maplvl,pos+eps.yyx,tmp) - map(maplvl,pos-eps.yyx,tmp) ) );
+        map(maplvl,offsetPos(pos,eps.xyy),tmp) - map(maplvl,offsetPos(pos,-eps.xyy),tmp),
+        map(maplvl,offsetPos(pos,eps.yxy),tmp) - map(maplvl,offsetPos(pos,-eps.yxy),tmp),
+        map(maplvl,offsetPos(pos,eps.yyx),tmp) - map(maplvl,offsetPos(pos,-eps.yyx),tmp) ) );
 
 }
 
@@ -212,8 +771,25 @@ const vec3 light1 = vec3(  0.577, 0.577, -0.577 );
 const vec3 light2 = vec3( -0.707, 0.000,  0.707 );
 
 
+// maps a pixel of the warped framebuffer to where it lands in `resolution`
+// Along each axis, the distance from the gaze point is warped by a cubic
+// whose slope is `foveaDensity` at the gaze point and steepens outwards
+vec2 foveaToScreen(vec2 b)
+{
+  vec2 gb = gazePoint*bufferResolution/resolution;
+  vec2 side = step(gb, b);
+  vec2 lb = mix(gb, bufferResolution - gb, side);
+  vec2 l = mix(gazePoint, resolution - gazePoint, side);
+  vec2 u = abs(b - gb)/max(lb, vec2(1.));
+  vec2 s = foveaDensity*u + (1. - foveaDensity)*u*u*u;
+  return gazePoint + sign(b - gb)*s*l;
+}
+
 vec3 render( in vec2 p, in mat4 cam )
 {
+  if(foveated)
+    p = foveaToScreen(p);
+
   // ray setup
   // this is our distance from the bulb
 
@@ -225,17 +801,79 @@ vec3 render( in vec2 p, in mat4 cam )
   vec2  sp = (-resolution.xy + 2.0*p) / smallestaxis;
   float px = 2.0/(smallestaxis*fle);
 
-  // extract translation component of view matrix
-  vec3  ro = camOrigin;
+  // the camera in fractal space
+  pos3 origin = fractalOrigin();
   // extract direction from view matrix and given pixel to be marched
   vec3  rd = normalize( (cam*vec4(sp,fle,0.0)).xyz );
+  if(octahedral)
+  {
+    // the sphere's 4 pi spread evenly over the pixels
+    rd = normalize(equalAreaDirection(p/resolution));
+    px = 2.*sqrt(3.14159265)/smallestaxis;
+  }
+
+  stepBudget = intersectStepCount;
+  iterDrop = 0;
+  if(foveated)
+  {
+    float ecc = acos(clamp(dot(rd, gazeDir), -1., 1.));
+    stepBudget = max(int(intersectStepCount*clamp(1. - foveaStepFalloff*ecc, .1, 1.)), 1);
+    iterDrop = int(foveaIterFalloff*ecc);
+  }
+  iterDrop -= iterBoost;
 
   // intersect fractal
   vec4 tra;
-  // rounded to integer
-  ivec2 ip = ivec2(p);
+  // rounded to integer, in the framebuffer being drawn to
+  ivec2 ip = ivec2(gl_FragCoord.xy);
   int g=0;
-  float t = intersect( ro, rd, tra, px, ip,g );
+  float t;
+
+  // surface terms, either marched for or read back from the g-buffer
+  vec3 nor = vec3(0.0);
+  float sha1 = 0.0;
+  vec4 material = vec4(0.0);
+  if(shadeOnly)
+  {
+    t = decodeDepth(imageLoad(gbufferDepth, faceCoord(ip)).r);
+    // unresolved rays stay unresolved, and ones resolved in front stay
+    // theirs
+    if(t <= 0.)
+      discard;
+    if(t >= SKY_DEPTH*.5)
+      t = -1.;
+    vec4 n = imageLoad(gbufferNormal, faceCoord(ip));
+    nor = n.xyz;
+    sha1 = n.w;
+    material = imageLoad(gbufferMaterial, faceCoord(ip));
+  }
+  else
+  {
+    if(depthOnly)
+      iterDrop += guideIterDrop;
+    t = intersect( origin, rd, tra, px, ip,g );
+    if(depthOnly)
+      return vec3(t < 0. ? SKY_DEPTH : t);
+
+    if( t>=0.0 )
+    {
+      pos3 pos = offsetPos(origin, rd*(t/float(zoomLevel)));
+      nor = calcNormal( g, pos, t, px );
+      // sun
+      // lifted off by about half a pixel, rather than a fixed distance the
+      // bulb shrinks away from as it gets zoomed into
+      sha1 = softshadow( offsetPos(pos, 0.5*px*t/float(zoomLevel)*nor), light1, shadowSharpness, px, t );
+      //float sha1 = 1.0; //softshadow( pos+0.001*nor, light1, 32.0 );
+      // color weights, and occlusion
+      material = vec4(clamp(tra.y,0.0,1.0), clamp(tra.z*tra.z,0.0,1.0), clamp(pow(tra.w,6.0),0.0,1.0), clamp(0.05*log(tra.x),0.0,1.0));
+    }
+
+    if(writeGBuffer)
+    {
+      imageStore(gbufferNormal, faceCoord(ip), vec4(nor, sha1));
+      imageStore(gbufferMaterial, faceCoord(ip), material);
+    }
+  }
 
   vec3 col;
 
@@ -253,23 +891,19 @@ vec3 render( in vec2 p, in mat4 cam )
   {
     // color
     col = vec3(0.01);
-    col = mix( col, yColor, clamp(tra.y,0.0,1.0) );
-    col = mix( col, zColor, clamp(tra.z*tra.z,0.0,1.0) );
-    col = mix( col, wColor, clamp(pow(tra.w,6.0),0.0,1.0) );
+    col = mix( col, yColor, material.x );
+    col = mix( col, zColor, material.y );
+    col = mix( col, wColor, material.z );
     col *= 0.5;
     //col = vec3(0.1);
 
     // lighting terms
-    vec3 pos = (ro + t*rd)/zoomLevel;
-    vec3 nor = calcNormal( g, pos, t, px );
     vec3 hal = normalize( light1-rd);
     vec3 ref = reflect( rd, nor );
-    float occ = clamp(0.05*log(tra.x),0.0,1.0);
+    float occ = material.w;
     float fac = clamp(1.0+dot(rd,nor),0.0,1.0);
 
     // sun
-    float sha1 = softshadow( pos+0.001*nor, light1, 32.0 );
-    //float sha1 = 1.0; //softshadow( pos+0.001*nor, light1, 32.0 );
     float dif1 = clamp( dot( light1, nor ), 0.0, 1.0 )*sha1;
     float spe1 = pow( clamp(dot(nor,hal),0.0,1.0), 32.0 )*dif1*(0.04+0.96*pow(clamp(1.0-dot(hal,light1),0.0,1.0),5.0));
     // bounce
@@ -301,16 +935,28 @@ vec3 render( in vec2 p, in mat4 cam )
 
 void main()
 {
+  if(interleave > 1)
+  {
+    ivec2 ip = ivec2(gl_FragCoord.xy);
+    int slot = interleave == 2 ? ((ip.x + ip.y) & 1) : (ip.x & 1) + 2*(ip.y & 1);
+    if(slot != interleavePhase)
+      discard;
+  }
+
+#ifdef LAYERED_FACES
+  mat4 cam = faceView(gl_Layer);
+#else
   mat4 cam = view;
+#endif
   // render
 #if AA<2
-  vec3 col = render(  gl_FragCoord.xy, cam );
+  vec3 col = render(  gl_FragCoord.xy + jitter, cam );
 #else
   vec3 col = vec3(0.0);
   for( int j=0; j<AA; j++ )
     for( int i=0; i<AA; i++ )
     {
-      col += render( gl_FragCoord .xy+ (vec2(i,j)/float(AA)), cam );
+      col += render( gl_FragCoord .xy+ jitter + (vec2(i,j)/float(AA)), cam );
     }
   col /= float(AA*AA);
 #endif
@@ -0,0 +1,13 @@
+#version 430 core
+
+// folds one sample into a running average, through alpha blending
+uniform sampler2D sampleColor;
+// 1/n for the nth sample
+uniform float weight;
+
+out vec4 color;
+
+void main()
+{
+  color = vec4(texelFetch(sampleColor, ivec2(gl_FragCoord.xy), 0).rgb, weight);
+}
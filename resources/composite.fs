@@ -0,0 +1,296 @@
+#version 430 core
+
+// every displayed onion layer in one full screen pass, front to back. Each
+// pixel takes the first layer that resolved it, so the layers behind only
+// cost a fetch where the ones in front left a gap
+
+// two samplers each plus the two of the tiles below, within the 16 units
+// GL 4.3 guarantees. Matches MarchingManager::MAX_COMPOSITE_LAYERS
+#define MAX_LAYERS 7
+uniform int layerCount;
+// front to back, the cube faces of each layer and their march distances,
+// as written to `outputDepthBuffer`
+uniform sampler2DArray colorMaps[MAX_LAYERS];
+uniform sampler2DArray depthMaps[MAX_LAYERS];
+// set for layers whose depths are log packed into 16 bits over
+// `depthLogRange`, as the march shader's PACKED_DEPTH writes them
+uniform bool packedDepth[MAX_LAYERS];
+uniform vec2 depthLogRange;
+
+// when set, a layer is warped from where it was captured to the current eye
+uniform bool reproject[MAX_LAYERS];
+// the eye less where the layer was captured, in fractal space
+uniform vec3 eyeShift[MAX_LAYERS];
+// converts the stored world space depths into fractal space
+uniform float captureScale[MAX_LAYERS];
+// the part of each face that got marched, at the resolution scale in use
+uniform vec2 faceScale[MAX_LAYERS];
+// set for layers that are a single equal area octahedral map of every
+// direction, in layer 0 of their arrays, rather than cube faces
+uniform bool octahedral[MAX_LAYERS];
+// the indirect draw each layer was last marched through, or -1. Layers
+// whose pass got no instance still hold an older march
+uniform int layerPass[MAX_LAYERS];
+struct DrawCommand {
+  uint count;
+  uint instanceCount;
+  uint first;
+  uint baseInstance;
+};
+layout(std430, binding = 1) readonly buffer layerPasses {
+  DrawCommand passes[];
+};
+
+// detail tiles, see TileCache: whole marches of parts of the cube faces at
+// `virtualSize` and every halving of it, `tileLevels` of those, from where
+// the camera is now. Only drawn with the front layers
+uniform bool tiled;
+uniform int virtualSize;
+uniform int tileSize;
+uniform int tileLevels;
+// the slot each tile is in plus 1, 0 while it isn't, a level per halving
+uniform usampler2DArray pageTable;
+// `atlasSlots` along each side
+uniform sampler2D tileAtlas;
+uniform int atlasSlots;
+// the tiles the pixels would want, each listed once, for the CPU to march
+uniform int maxTileRequests;
+layout(std430, binding = 2) buffer tileRequests {
+  uint requestCount;
+  uint requestList[];
+};
+layout(std430, binding = 3) buffer tileFlags {
+  uint requested[];
+};
+
+uniform vec2 resolution;
+// the camera basis, as glm::lookAt builds it
+uniform vec3 camRight;
+uniform vec3 camUp;
+uniform vec3 camForward;
+
+out vec4 color;
+
+#define SKY_DEPTH 1e20
+#define REPROJECT_ITERS 4
+// how far a reprojected sample may land from the eye ray, relative to its
+// distance, before it is considered disoccluded
+#define REPROJECT_TOLERANCE 0.02
+
+// the axis each face of `texture_dirs` was marched along, along with the
+// screen x and y axes it was marched with
+const vec3 faceAxis[6] = vec3[6](
+  vec3( 0, 0,-1), vec3(-1, 0, 0), vec3( 1, 0, 0),
+  vec3( 0, 0, 1), vec3( 0, 1, 0), vec3( 0,-1, 0));
+const vec3 faceRight[6] = vec3[6](
+  vec3(-1, 0, 0), vec3( 0, 0, 1), vec3( 0, 0,-1),
+  vec3( 1, 0, 0), vec3( 1, 0, 0), vec3( 1, 0, 0));
+const vec3 faceUp[6] = vec3[6](
+  vec3( 0, 1, 0), vec3( 0, 1, 0), vec3( 0, 1, 0),
+  vec3( 0, 1, 0), vec3( 0, 0,-1), vec3( 0, 0, 1));
+
+// the direction of this pixel from the center of the cube. The view is the
+// one the layers were always shown with: a pinhole on the back of the unit
+// cube around the camera, looking through its far side, the shorter axis
+// of the screen fit to it
+vec3 viewDirection()
+{
+  float smallestaxis = min(resolution.x, resolution.y);
+  vec2 sp = (2.*gl_FragCoord.xy - resolution)/smallestaxis;
+  vec3 o = camForward;
+  vec3 w = sp.x*camRight + sp.y*camUp - camForward;
+  // where the ray leaves the cube
+  vec3 exits = (sign(w) - o)/w;
+  float t = min(min(w.x != 0. ? exits.x : 1e20, w.y != 0. ? exits.y : 1e20), w.z != 0. ? exits.z : 1e20);
+  return o + t*w;
+}
+
+// maps a coordinate over a whole face of layer `i` into the marched part
+vec3 faceCoord(int i, vec3 f)
+{
+  vec2 texel = 1./vec2(textureSize(colorMaps[i], 0).xy);
+  return vec3(clamp(f.xy*faceScale[i], .5*texel, faceScale[i] - .5*texel), f.z);
+}
+
+// where the march shader's equalAreaDirection gave `d`, on the unit square
+vec2 equalAreaSquare(vec3 d)
+{
+  vec3 a = abs(d);
+  float r = sqrt(max(1. - a.z, 0.));
+  float big = max(a.x, a.y);
+  float phi = atan(big == 0. ? 0. : min(a.x, a.y)/big)*2./3.14159265;
+  if(a.x < a.y)
+    phi = 1. - phi;
+  vec2 uv = vec2(r - phi*r, phi*r);
+  if(d.z < 0.)
+    uv = 1. - uv.yx;
+  uv *= vec2(d.x < 0. ? -1. : 1., d.y < 0. ? -1. : 1.);
+  return .5*uv + .5;
+}
+
+// the cube face a direction goes through, and where on it, over [0, 1]
+vec3 dirToCube(vec3 d)
+{
+  int face = 0;
+  float best = -2.;
+  for(int k = 0; k < 6; k++)
+  {
+    float z = dot(d, faceAxis[k]);
+    if(z > best)
+    {
+      best = z;
+      face = k;
+    }
+  }
+  vec2 sp = vec2(dot(d, faceRight[face]), dot(d, faceUp[face]))/best;
+  return vec3(0.5 + 0.5*sp, face);
+}
+
+// finds the face and texture coordinate a direction was marched at
+vec3 dirToFace(int i, vec3 d)
+{
+  if(octahedral[i])
+    return faceCoord(i, vec3(equalAreaSquare(normalize(d)), 0.));
+  return faceCoord(i, dirToCube(d));
+}
+
+// tile `tile` of `face` at `level`, in the flat order of TileCache
+int tileIndex(int level, int face, ivec2 tile)
+{
+  int offset = 0;
+  for(int l = 0; l < level; l++)
+  {
+    int m = (virtualSize/tileSize) >> l;
+    offset += 6*m*m;
+  }
+  int n = (virtualSize/tileSize) >> level;
+  return offset + (face*n + tile.y)*n + tile.x;
+}
+
+// the texel of `cube` at `level`, and the tile it is in
+vec2 tileTexel(vec3 cube, int level, out ivec2 tile)
+{
+  vec2 texel = cube.xy*float(virtualSize >> level);
+  int n = (virtualSize/tileSize) >> level;
+  tile = min(ivec2(texel)/tileSize, ivec2(n - 1));
+  return texel;
+}
+
+void requestTile(vec3 cube, int level)
+{
+  ivec2 tile;
+  tileTexel(cube, level, tile);
+  int index = tileIndex(level, int(cube.z), tile);
+  if(atomicExchange(requested[index], 1u) != 0u)
+    return;
+  uint n = atomicAdd(requestCount, 1u);
+  if(n < uint(maxTileRequests))
+    requestList[n] = uint(index);
+}
+
+// the color of the finest tile in at `level` or coarser, false for none
+bool sampleTiles(vec3 cube, int level, out vec4 c)
+{
+  for(int l = level; l < tileLevels; l++)
+  {
+    ivec2 tile;
+    vec2 texel = tileTexel(cube, l, tile);
+    uint entry = texelFetch(pageTable, ivec3(tile, int(cube.z)), l).r;
+    if(entry == 0u)
+      continue;
+    int slot = int(entry) - 1;
+    ivec2 corner = ivec2(slot%atlasSlots, slot/atlasSlots)*tileSize;
+    // filtered within the tile only, its neighbours in the atlas are others
+    vec2 inTile = clamp(texel - vec2(tile*tileSize), vec2(.5), vec2(tileSize) - .5);
+    c = textureLod(tileAtlas, (vec2(corner) + inTile)/vec2(textureSize(tileAtlas, 0)), 0.);
+    return true;
+  }
+  return false;
+}
+
+// the march distance layer `i` stored at `face`
+float layerDepth(int i, vec3 face)
+{
+  float e = textureLod(depthMaps[i], face, 0.).r;
+  if(!packedDepth[i])
+    return e;
+  float a = abs(e);
+  if(a == 0. || a >= 1.)
+    return sign(e)*(a == 0. ? 0. : SKY_DEPTH);
+  return sign(e)*exp2(mix(depthLogRange.x, depthLogRange.y, a));
+}
+
+// the color layer `i` has for direction `d`, false where it left the pixel
+// to the layers behind it
+bool sampleLayer(int i, vec3 d, out vec4 c)
+{
+  vec3 face = dirToFace(i, d);
+  float tc = layerDepth(i, face);
+  if(!reproject[i])
+  {
+    c = texture(colorMaps[i], face);
+    return tc > 0.;
+  }
+
+  // fixed point iteration: find the distance `s` along the eye ray whose
+  // point is also what the capture origin saw in that direction
+  vec3 delta = eyeShift[i];
+  float s = tc/captureScale[i];
+  vec3 dc = d;
+  for(int k = 0; k < REPROJECT_ITERS && tc > 0. && tc < SKY_DEPTH; k++)
+  {
+    dc = normalize(delta + s*d);
+    face = dirToFace(i, dc);
+    tc = layerDepth(i, face);
+    s = max(dot(dc*(tc/captureScale[i]) - delta, d), 0.);
+  }
+
+  // unresolved in this layer
+  if(tc <= 0.)
+    return false;
+
+  if(tc >= SKY_DEPTH)
+  {
+    // nothing to parallax against at infinity
+    c = texture(colorMaps[i], dirToFace(i, d));
+    return true;
+  }
+
+  // landed on a different surface than the one the eye ray hits
+  if(length(delta + s*d - dc*(tc/captureScale[i])) > REPROJECT_TOLERANCE*max(s, 1e-6))
+    return false;
+
+  c = texture(colorMaps[i], face);
+  return true;
+}
+
+void main()
+{
+  vec3 d = normalize(viewDirection());
+  if(tiled)
+  {
+    // texels of the finest level across this pixel, from the angle it
+    // spans. Off the face's center an angle covers up to 1/z² more of it
+    vec3 a = abs(d);
+    float z = max(max(a.x, a.y), a.z);
+    float angle = max(length(dFdx(d)), length(dFdy(d)));
+    float footprint = .5*angle*float(virtualSize)/(z*z);
+    int level = int(floor(log2(max(footprint, 1.))));
+    if(level < tileLevels)
+    {
+      vec3 cube = dirToCube(d);
+      requestTile(cube, level);
+      if(sampleTiles(cube, level, color))
+        return;
+    }
+  }
+  for(int i = 0; i < layerCount; i++)
+  {
+    if(layerPass[i] >= 0 && passes[layerPass[i]].instanceCount == 0u)
+      continue;
+    if(sampleLayer(i, d, color))
+      return;
+  }
+  // left to whatever is drawn behind
+  discard;
+}
@@ -0,0 +1,17 @@
+#version 430 core
+
+// hands the plane on to every face of a cube layer, one invocation each,
+// the face going out as the layer of the framebuffer to draw into
+layout(triangles, invocations = 6) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+void main()
+{
+  for(int i = 0; i < 3; i++)
+  {
+    gl_Layer = gl_InvocationID;
+    gl_Position = gl_in[i].gl_Position;
+    EmitVertex();
+  }
+  EndPrimitive();
+}
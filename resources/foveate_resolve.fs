@@ -0,0 +1,48 @@
+#version 430 core
+
+// unwarps a foveated march back to full resolution
+
+uniform sampler2D foveaColor;
+uniform sampler2D foveaDepth;
+
+layout(r32f) uniform restrict writeonly image2D outputDepthBuffer;
+uniform bool writeDepth;
+
+uniform vec2 resolution;
+uniform vec2 bufferResolution;
+uniform vec2 gazePoint;
+uniform float foveaDensity;
+
+out vec4 color;
+
+// inverse of `foveaToScreen` in the march shader: finds the warped
+// coordinate of a screen pixel, solving the cubic warp with newton's method
+vec2 screenToFovea(vec2 x)
+{
+  vec2 gb = gazePoint*bufferResolution/resolution;
+  vec2 side = step(gazePoint, x);
+  vec2 lb = mix(gb, bufferResolution - gb, side);
+  vec2 l = mix(gazePoint, resolution - gazePoint, side);
+  vec2 s = abs(x - gazePoint)/max(l, vec2(1.));
+
+  vec2 u = s;
+  for(int i = 0; i < 4; i++)
+  {
+    vec2 f = foveaDensity*u + (1. - foveaDensity)*u*u*u - s;
+    vec2 df = foveaDensity + 3.*(1. - foveaDensity)*u*u;
+    u = clamp(u - f/df, 0., 1.);
+  }
+  return gb + sign(x - gazePoint)*u*lb;
+}
+
+void main()
+{
+  vec2 b = screenToFovea(gl_FragCoord.xy);
+  color = texture(foveaColor, b/bufferResolution);
+
+  if(writeDepth)
+  {
+    ivec2 bp = clamp(ivec2(b), ivec2(0), ivec2(bufferResolution) - 1);
+    imageStore(outputDepthBuffer, ivec2(gl_FragCoord.xy), texelFetch(foveaDepth, bp, 0));
+  }
+}
@@ -0,0 +1,142 @@
+#version 430 core
+
+// fills in the pixels an interleaved march skipped this frame, by
+// reprojecting the last frame with the depths of the marched neighbours
+
+uniform sampler2D currentColor;
+uniform sampler2D currentDepth;
+uniform sampler2D historyColor;
+uniform sampler2D historyDepth;
+uniform bool historyValid;
+
+// 1 in `interleave` pixels gets marched a frame, those of slot `interleavePhase`
+uniform int interleave;
+uniform int interleavePhase;
+
+uniform vec2 resolution;
+uniform float fle;
+
+// the basis rays get built from, as in the march
+uniform vec3 camRight;
+uniform vec3 camUp;
+uniform vec3 camForward;
+uniform float zoomLevel;
+
+// the same, for the frame in the history. Its camera only as this one
+// less it, in fractal space, so only the difference goes through floats
+uniform vec3 originShift;
+uniform vec3 prevRight;
+uniform vec3 prevUp;
+uniform vec3 prevForward;
+uniform float prevZoomLevel;
+
+layout(rgba8) uniform restrict writeonly image2D historyColorOut;
+layout(r32f) uniform restrict writeonly image2D historyDepthOut;
+layout(r32f) uniform restrict writeonly image2D outputDepthBuffer;
+uniform bool writeDepth;
+
+#define SKY_DEPTH 1e20
+// how far, relative to the distance, the history may be off and still match
+#define HISTORY_TOLERANCE .05
+
+out vec4 color;
+
+int slot(ivec2 p)
+{
+  return interleave == 2 ? ((p.x + p.y) & 1) : (p.x & 1) + 2*(p.y & 1);
+}
+
+bool marched(ivec2 p)
+{
+  return slot(p) == interleavePhase
+    && all(greaterThanEqual(p, ivec2(0)))
+    && all(lessThan(p, ivec2(resolution)));
+}
+
+// tries `t` as the depth along `rd`, true when the last frame agrees with it
+bool reproject(vec3 rd, float t, out vec4 c, out float depth)
+{
+  bool sky = t >= SKY_DEPTH*.5;
+  // from the old origin, in fractal space, as the zoom may have changed
+  vec3 d = sky ? rd : rd*(abs(t)/zoomLevel) + originShift;
+
+  float z = -dot(d, prevForward);
+  if(z <= 0.)
+    return false;
+  vec2 sp = vec2(dot(d, prevRight), dot(d, prevUp))*fle/z;
+  vec2 hp = (sp*min(resolution.x, resolution.y) + resolution)*.5;
+  if(any(lessThan(hp, vec2(0.))) || any(greaterThanEqual(hp, resolution)))
+    return false;
+
+  ivec2 hq = ivec2(hp);
+  float hd = texelFetch(historyDepth, hq, 0).r;
+  if(sky != (hd >= SKY_DEPTH*.5))
+    return false;
+  if(!sky)
+  {
+    // unresolved rays only stand in for unresolved rays
+    if((hd < 0.) != (t < 0.))
+      return false;
+    float expected = length(d);
+    if(abs(abs(hd)/prevZoomLevel - expected) > HISTORY_TOLERANCE*expected)
+      return false;
+  }
+
+  c = texelFetch(historyColor, hq, 0);
+  depth = t;
+  return true;
+}
+
+void main()
+{
+  ivec2 ip = ivec2(gl_FragCoord.xy);
+  vec4 c;
+  float depth;
+
+  if(marched(ip))
+  {
+    c = texelFetch(currentColor, ip, 0);
+    depth = texelFetch(currentDepth, ip, 0).r;
+  }
+  else
+  {
+    float smallestaxis = min(resolution.x, resolution.y);
+    vec2 sp = (-resolution + 2.*gl_FragCoord.xy)/smallestaxis;
+    vec3 rd = normalize(sp.x*camRight + sp.y*camUp - fle*camForward);
+
+    bool found = false;
+    vec4 spatial = vec4(0.);
+    float n = 0.;
+    depth = SKY_DEPTH;
+    for(int j = -1; j <= 1; j++)
+      for(int i = -1; i <= 1; i++)
+      {
+        ivec2 q = ip + ivec2(i, j);
+        if(!marched(q))
+          continue;
+        float t = texelFetch(currentDepth, q, 0).r;
+        spatial += texelFetch(currentColor, q, 0);
+        if(n == 0.)
+          depth = t;
+        n += 1.;
+        vec4 hc;
+        float hd;
+        if(!found && historyValid && reproject(rd, t, hc, hd))
+        {
+          found = true;
+          c = hc;
+          depth = hd;
+        }
+      }
+
+    // nothing in the history fits, so blend the marched neighbours
+    if(!found)
+      c = spatial/max(n, 1.);
+  }
+
+  color = c;
+  imageStore(historyColorOut, ip, c);
+  imageStore(historyDepthOut, ip, vec4(depth));
+  if(writeDepth)
+    imageStore(outputDepthBuffer, ip, vec4(depth));
+}
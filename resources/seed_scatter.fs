@@ -0,0 +1,54 @@
+#version 430 core
+
+// scatters the hits of the last frame into the current view, each pixel
+// of `seedBuffer` keeping the bits of the nearest distance landing on it
+
+// drawn at the size of the last frame, one fragment per pixel of it
+uniform sampler2D prevDepth;
+
+uniform vec2 resolution;
+uniform float fle;
+
+// the basis rays get built from, as in the march
+uniform vec3 camRight;
+uniform vec3 camUp;
+uniform vec3 camForward;
+uniform float zoomLevel;
+
+// the last camera less this one, in fractal space, so only the difference
+// between them goes through floats
+uniform vec3 originShift;
+uniform vec3 prevRight;
+uniform vec3 prevUp;
+uniform vec3 prevForward;
+uniform float prevZoomLevel;
+
+layout(r32ui) uniform restrict coherent uimage2D seedBuffer;
+
+#define SKY_DEPTH 1e20
+
+void main()
+{
+  ivec2 ip = ivec2(gl_FragCoord.xy);
+  float t = texelFetch(prevDepth, ip, 0).r;
+  // only real hits, unresolved rays and the sky say nothing about the surface
+  if(t <= 0. || t >= SKY_DEPTH*.5)
+    return;
+
+  float smallestaxis = min(resolution.x, resolution.y);
+  vec2 sp = (-resolution + 2.*gl_FragCoord.xy)/smallestaxis;
+  vec3 rd = normalize(sp.x*prevRight + sp.y*prevUp - fle*prevForward);
+
+  // in fractal space, as the zoom may have changed
+  vec3 d = rd*(t/prevZoomLevel) + originShift;
+  float z = -dot(d, camForward);
+  if(z <= 0.)
+    return;
+  vec2 cp = vec2(dot(d, camRight), dot(d, camUp))*fle/z;
+  vec2 q = (cp*smallestaxis + resolution)*.5;
+  if(any(lessThan(q, vec2(0.))) || any(greaterThanEqual(q, resolution)))
+    return;
+
+  // back to world units, positive floats sort like uints
+  imageAtomicMin(seedBuffer, ivec2(q), floatBitsToUint(length(d)*zoomLevel));
+}
@@ -0,0 +1,64 @@
+#version 430 core
+
+// joint bilateral upsampling of a reduced resolution march, guided by a
+// cheap full resolution march of just the depths
+
+uniform sampler2D lowColor;
+uniform sampler2D lowDepth;
+uniform sampler2D guideDepth;
+
+// the part of the low resolution targets in use, and the output size
+uniform vec2 lowResolution;
+uniform vec2 resolution;
+
+// how different, relative to the guide, a depth may be and still blend
+uniform float depthSigma;
+
+layout(r32f) uniform restrict writeonly image2D outputDepthBuffer;
+uniform bool writeDepth;
+
+out vec4 color;
+
+void main()
+{
+  ivec2 fp = ivec2(gl_FragCoord.xy);
+  float g = texelFetch(guideDepth, fp, 0).r;
+
+  // position in the low resolution grid, relative to its texel centers
+  vec2 lp = gl_FragCoord.xy*lowResolution/resolution - .5;
+  ivec2 base = ivec2(floor(lp));
+  vec2 fr = lp - vec2(base);
+
+  vec4 sum = vec4(0.);
+  float wsum = 0.;
+  vec4 bestColor = vec4(0.);
+  float bestDepth = 0.;
+  float bestSim = -1.;
+  for(int j = 0; j < 2; j++)
+    for(int i = 0; i < 2; i++)
+    {
+      ivec2 q = clamp(base + ivec2(i, j), ivec2(0), ivec2(lowResolution) - 1);
+      vec4 c = texelFetch(lowColor, q, 0);
+      // unresolved rays store how far they got as a negative depth
+      float d = texelFetch(lowDepth, q, 0).r;
+
+      float bw = (i == 1 ? fr.x : 1. - fr.x)*(j == 1 ? fr.y : 1. - fr.y);
+      float rel = (abs(d) - g)/max(min(abs(d), g), 1e-6);
+      float sim = exp(-rel*rel/(depthSigma*depthSigma));
+
+      sum += c*bw*sim;
+      wsum += bw*sim;
+      if(sim > bestSim)
+      {
+        bestSim = sim;
+        bestColor = c;
+        bestDepth = d;
+      }
+    }
+
+  // nothing on the guide's side of the edge, take the closest match
+  color = wsum > 1e-4 ? sum/wsum : bestColor;
+
+  if(writeDepth)
+    imageStore(outputDepthBuffer, fp, vec4(bestDepth));
+}
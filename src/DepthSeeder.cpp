@@ -0,0 +1,160 @@
+#include "DepthSeeder.h"
+
+#include <iostream>
+#include <glm/gtc/type_ptr.hpp>
+
+// for the unit plane
+#include "MandelRenderer.h"
+
+void DepthSeeder::init(const std::string &resourceDirectory)
+{
+  scatterShader = std::make_shared<Program>();
+  scatterShader->setVerbose(true);
+  scatterShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/seed_scatter.fs");
+  if (!scatterShader->init())
+  {
+    std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+    exit(1);
+  }
+  scatterShader->addAttribute("vertPos");
+  scatterShader->addUniform("prevDepth");
+  scatterShader->addUniform("resolution");
+  scatterShader->addUniform("fle");
+  scatterShader->addUniform("camRight");
+  scatterShader->addUniform("camUp");
+  scatterShader->addUniform("camForward");
+  scatterShader->addUniform("zoomLevel");
+  scatterShader->addUniform("originShift");
+  scatterShader->addUniform("prevRight");
+  scatterShader->addUniform("prevUp");
+  scatterShader->addUniform("prevForward");
+  scatterShader->addUniform("prevZoomLevel");
+  scatterShader->addUniform("seedBuffer");
+}
+
+void DepthSeeder::release(View &v)
+{
+  if(v.depthTex)
+  {
+    glDeleteTextures(1, &v.depthTex);
+    glDeleteTextures(1, &v.seedTex);
+    glDeleteFramebuffers(1, &v.seedFramebuf);
+    glDeleteFramebuffers(1, &v.scatterFramebuf);
+  }
+  v.depthTex = v.seedTex = v.seedFramebuf = v.scatterFramebuf = 0;
+}
+
+DepthSeeder::~DepthSeeder()
+{
+  for(auto &entry : views)
+  {
+    release(entry.second);
+  }
+}
+
+GLuint DepthSeeder::begin(int key, glm::vec2 size, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, float fle, int geometryRev)
+{
+  View &v = views[key];
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  
+  if(v.width != w || v.height != h)
+  {
+    release(v);
+    v.width = w;
+    v.height = h;
+    v.valid = false;
+    
+    glGenTextures(1, &v.depthTex);
+    glGenTextures(1, &v.seedTex);
+    glGenFramebuffers(1, &v.seedFramebuf);
+    glGenFramebuffers(1, &v.scatterFramebuf);
+    
+    glBindTexture(GL_TEXTURE_2D, v.depthTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
+    glBindTexture(GL_TEXTURE_2D, v.seedTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, w, h);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, v.seedFramebuf);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, v.seedTex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, v.scatterFramebuf);
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_WIDTH, w);
+    glFramebufferParameteri(GL_FRAMEBUFFER, GL_FRAMEBUFFER_DEFAULT_HEIGHT, h);
+  }
+  
+  v.nextPos = pos;
+  v.nextForward = forward;
+  v.nextUp = up;
+  v.nextZoomLevel = zoomLevel;
+  v.nextRevision = geometryRev;
+  
+  if(!v.valid || v.revision != geometryRev)
+    return 0;
+  
+  // nothing landed anywhere yet
+  GLuint farthest[4] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu};
+  glBindFramebuffer(GL_FRAMEBUFFER, v.seedFramebuf);
+  glClearBufferuiv(GL_COLOR, 0, farthest);
+  
+  // the last depths were written through image stores
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glBindFramebuffer(GL_FRAMEBUFFER, v.scatterFramebuf);
+  glViewport(0, 0, w, h);
+  
+  scatterShader->bind();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, v.depthTex);
+  glUniform1i(scatterShader->getUniform("prevDepth"), 0);
+  glBindImageTexture(2, v.seedTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+  glUniform1i(scatterShader->getUniform("seedBuffer"), 2);
+  
+  glUniform2f(scatterShader->getUniform("resolution"), size.x, size.y);
+  glUniform1f(scatterShader->getUniform("fle"), fle);
+  
+  // the same basis the march builds its rays from
+  glm::vec3 right = glm::normalize(glm::cross(forward, up));
+  glm::vec3 trueUp = glm::cross(right, forward);
+  glUniform3fv(scatterShader->getUniform("camRight"), 1, glm::value_ptr(right));
+  glUniform3fv(scatterShader->getUniform("camUp"), 1, glm::value_ptr(trueUp));
+  glUniform3fv(scatterShader->getUniform("camForward"), 1, glm::value_ptr(forward));
+  glUniform1f(scatterShader->getUniform("zoomLevel"), static_cast<float>(zoomLevel));
+  
+  glm::vec3 prevRight = glm::normalize(glm::cross(v.forward, v.up));
+  glm::vec3 prevUp = glm::cross(prevRight, v.forward);
+  glm::vec3 shift(v.pos/v.zoomLevel - pos/zoomLevel);
+  glUniform3fv(scatterShader->getUniform("originShift"), 1, glm::value_ptr(shift));
+  glUniform3fv(scatterShader->getUniform("prevRight"), 1, glm::value_ptr(prevRight));
+  glUniform3fv(scatterShader->getUniform("prevUp"), 1, glm::value_ptr(prevUp));
+  glUniform3fv(scatterShader->getUniform("prevForward"), 1, glm::value_ptr(v.forward));
+  glUniform1f(scatterShader->getUniform("prevZoomLevel"), static_cast<float>(v.zoomLevel));
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  scatterShader->unbind();
+  
+  // the march reads the seeds with image loads
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  return v.seedTex;
+}
+
+GLuint DepthSeeder::getDepthBuf(int key)
+{
+  return views[key].depthTex;
+}
+
+void DepthSeeder::end(int key, GLuint depthBuf)
+{
+  View &v = views[key];
+  if(depthBuf != v.depthTex)
+  {
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    glCopyImageSubData(depthBuf, GL_TEXTURE_2D, 0, 0, 0, 0, v.depthTex, GL_TEXTURE_2D, 0, 0, 0, 0, v.width, v.height, 1);
+  }
+  
+  v.valid = true;
+  v.pos = v.nextPos;
+  v.forward = v.nextForward;
+  v.up = v.nextUp;
+  v.zoomLevel = v.nextZoomLevel;
+  v.revision = v.nextRevision;
+}
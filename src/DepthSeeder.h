@@ -0,0 +1,58 @@
+#ifndef __DEPTHSEEDER_H
+#define __DEPTHSEEDER_H
+
+#include <memory>
+#include <string>
+#include <map>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Program.h"
+
+// Temporal seeding of the direct views: the hits of the last frame get
+// reprojected into the current one, so rays can start close to where they
+// will end instead of at the bounding sphere. Views are kept apart by key,
+// as with the interleaving histories.
+class DepthSeeder
+{
+  struct View
+  {
+    // depths of the last frame, and the seeds scattered from them
+    GLuint depthTex = 0, seedTex = 0;
+    // the seed target gets cleared through `seedFramebuf`, and scattered
+    // into without attachments through `scatterFramebuf`
+    GLuint seedFramebuf = 0, scatterFramebuf = 0;
+    int width = 0, height = 0;
+    bool valid = false;
+    
+    // positions in doubles, only their difference goes to the GPU
+    glm::dvec3 pos = glm::dvec3(0);
+    glm::vec3 forward = glm::vec3(0, 0, -1), up = glm::vec3(0, 1, 0);
+    double zoomLevel = 1.;
+    // the geometry revision the last frame was marched with
+    int revision = 0;
+    // the camera of the march in progress, the history once it's done
+    glm::dvec3 nextPos;
+    glm::vec3 nextForward, nextUp;
+    double nextZoomLevel;
+    int nextRevision = 0;
+  };
+  std::map<int, View> views;
+  std::shared_ptr<Program> scatterShader;
+  
+  void release(View &v);
+public:
+  void init(const std::string &resourceDirectory);
+  ~DepthSeeder();
+  
+  // scatters the last frame of `key` into seeds for this camera, returning
+  // the seed buffer, or 0 when there is no usable last frame. One marched
+  // with another `geometryRev` isn't, its surfaces may be gone. Leaves its
+  // own framebuffer bound
+  GLuint begin(int key, glm::vec2 size, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, float fle, int geometryRev);
+  // where the march of `key` should write its depths, if nowhere else
+  GLuint getDepthBuf(int key);
+  // takes the depths the march wrote into `depthBuf` as the next last frame
+  void end(int key, GLuint depthBuf);
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef __FIXEDPOINT_H
+#define __FIXEDPOINT_H
+
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Signed fixed point numbers of `N` 32 bit limbs, the top one holding the
+// integer part, for places past what doubles can tell apart. Only as much
+// arithmetic as the reference orbits need: results get truncated, and the
+// integer part has to stay below 2^32.
+template<int N>
+struct FixedPoint
+{
+  // little endian, `limb[N - 1]` is the integer part
+  uint32_t limb[N];
+  bool negative = false;
+
+  FixedPoint()
+  {
+    for(int i = 0; i < N; i++)
+      limb[i] = 0;
+  }
+
+  explicit FixedPoint(double d)
+  {
+    negative = d < 0.;
+    d = std::fabs(d);
+    for(int i = N - 1; i >= 0; i--)
+    {
+      double whole = std::floor(d);
+      limb[i] = static_cast<uint32_t>(whole);
+      d = (d - whole)*4294967296.;
+    }
+    normalize();
+  }
+
+  double toDouble() const
+  {
+    double d = 0.;
+    for(int i = 0; i < N; i++)
+      d = d/4294967296. + limb[i];
+    return negative ? -d : d;
+  }
+
+  bool isZero() const
+  {
+    for(int i = 0; i < N; i++)
+      if(limb[i])
+        return false;
+    return true;
+  }
+
+  // the same number with `M` limbs, losing the lowest ones when shrinking
+  template<int M>
+  FixedPoint<M> resized() const
+  {
+    FixedPoint<M> r;
+    for(int k = 0; k < M && k < N; k++)
+      r.limb[M - 1 - k] = limb[N - 1 - k];
+    r.negative = negative;
+    r.normalize();
+    return r;
+  }
+
+  FixedPoint operator-() const
+  {
+    FixedPoint r = *this;
+    r.negative = !negative;
+    r.normalize();
+    return r;
+  }
+
+  FixedPoint operator+(const FixedPoint &b) const
+  {
+    FixedPoint r;
+    if(negative == b.negative)
+    {
+      addMagnitude(*this, b, r);
+      r.negative = negative;
+    }
+    else if(compareMagnitude(*this, b) >= 0)
+    {
+      subMagnitude(*this, b, r);
+      r.negative = negative;
+    }
+    else
+    {
+      subMagnitude(b, *this, r);
+      r.negative = b.negative;
+    }
+    r.normalize();
+    return r;
+  }
+
+  FixedPoint operator-(const FixedPoint &b) const
+  {
+    return *this + (-b);
+  }
+
+  FixedPoint operator*(const FixedPoint &b) const
+  {
+    // schoolbook, the product has twice the fraction limbs of either side
+    uint32_t p[2*N] = {0};
+    for(int i = 0; i < N; i++)
+    {
+      if(!limb[i])
+        continue;
+      uint64_t carry = 0;
+      for(int j = 0; j < N; j++)
+      {
+        uint64_t t = static_cast<uint64_t>(limb[i])*b.limb[j] + p[i + j] + carry;
+        p[i + j] = static_cast<uint32_t>(t);
+        carry = t >> 32;
+      }
+      p[i + N] = static_cast<uint32_t>(carry);
+    }
+
+    FixedPoint r;
+    for(int i = 0; i < N; i++)
+      r.limb[i] = p[i + N - 1];
+    r.negative = negative != b.negative;
+    r.normalize();
+    return r;
+  }
+
+  // times 2^bits
+  FixedPoint scaled(int bits) const
+  {
+    int limbs = bits >= 0 ? bits/32 : -((31 - bits)/32);
+    int shift = bits - 32*limbs;
+    FixedPoint r;
+    for(int i = 0; i < N; i++)
+    {
+      int src = i - limbs;
+      uint32_t at = src >= 0 && src < N ? limb[src] : 0;
+      uint32_t below = src >= 1 && src <= N ? limb[src - 1] : 0;
+      r.limb[i] = shift ? (at << shift) | (below >> (32 - shift)) : at;
+    }
+    r.negative = negative;
+    r.normalize();
+    return r;
+  }
+
+  // 1/sqrt(a) for a positive `a`, from the double estimate refined by
+  // Newton's method, every step doubling the bits that are right
+  static FixedPoint inverseSqrt(const FixedPoint &a)
+  {
+    FixedPoint y(1./std::sqrt(a.toDouble()));
+    const FixedPoint three(3.);
+    for(int bits = 48; bits < 32*N; bits *= 2)
+      y = (y*(three - a*y*y)).scaled(-1);
+    return y;
+  }
+
+private:
+  // zero has no sign
+  void normalize()
+  {
+    if(isZero())
+      negative = false;
+  }
+
+  static int compareMagnitude(const FixedPoint &a, const FixedPoint &b)
+  {
+    for(int i = N - 1; i >= 0; i--)
+      if(a.limb[i] != b.limb[i])
+        return a.limb[i] < b.limb[i] ? -1 : 1;
+    return 0;
+  }
+
+  static void addMagnitude(const FixedPoint &a, const FixedPoint &b, FixedPoint &r)
+  {
+    uint64_t carry = 0;
+    for(int i = 0; i < N; i++)
+    {
+      uint64_t s = static_cast<uint64_t>(a.limb[i]) + b.limb[i] + carry;
+      r.limb[i] = static_cast<uint32_t>(s);
+      carry = s >> 32;
+    }
+  }
+
+  // for |a| >= |b|
+  static void subMagnitude(const FixedPoint &a, const FixedPoint &b, FixedPoint &r)
+  {
+    uint64_t borrow = 0;
+    for(int i = 0; i < N; i++)
+    {
+      uint64_t d = static_cast<uint64_t>(a.limb[i]) - b.limb[i] - borrow;
+      r.limb[i] = static_cast<uint32_t>(d);
+      borrow = d >> 63;
+    }
+  }
+
+  template<int M> friend struct FixedPoint;
+};
+
+template<int N>
+struct FixedVec3
+{
+  FixedPoint<N> x, y, z;
+
+  FixedVec3() {}
+  explicit FixedVec3(glm::dvec3 v) : x(v.x), y(v.y), z(v.z) {}
+
+  glm::dvec3 toDouble() const
+  {
+    return glm::dvec3(x.toDouble(), y.toDouble(), z.toDouble());
+  }
+
+  template<int M>
+  FixedVec3<M> resized() const
+  {
+    FixedVec3<M> r;
+    r.x = x.template resized<M>();
+    r.y = y.template resized<M>();
+    r.z = z.template resized<M>();
+    return r;
+  }
+
+  FixedVec3 operator+(const FixedVec3 &b) const
+  {
+    FixedVec3 r;
+    r.x = x + b.x;
+    r.y = y + b.y;
+    r.z = z + b.z;
+    return r;
+  }
+
+  FixedVec3 operator+(glm::dvec3 d) const
+  {
+    return *this + FixedVec3(d);
+  }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "Foveation.h"
+
+#include <iostream>
+#include <cmath>
+
+// for the unit plane
+#include "MandelRenderer.h"
+
+void Foveation::init(const std::string &resourceDirectory)
+{
+  resolveShader = std::make_shared<Program>();
+  resolveShader->setVerbose(true);
+  resolveShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/foveate_resolve.fs");
+  if (!resolveShader->init())
+  {
+    std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+    exit(1);
+  }
+  resolveShader->addAttribute("vertPos");
+  resolveShader->addUniform("foveaColor");
+  resolveShader->addUniform("foveaDepth");
+  resolveShader->addUniform("outputDepthBuffer");
+  resolveShader->addUniform("writeDepth");
+  resolveShader->addUniform("resolution");
+  resolveShader->addUniform("bufferResolution");
+  resolveShader->addUniform("gazePoint");
+  resolveShader->addUniform("foveaDensity");
+}
+
+Foveation::~Foveation()
+{
+  release();
+}
+
+void Foveation::createTargets(int w, int h)
+{
+  release();
+  bufWidth = w;
+  bufHeight = h;
+  
+  glGenTextures(1, &colorTex);
+  glGenTextures(1, &depthTex);
+  glGenFramebuffers(1, &framebuf);
+  
+  glBindTexture(GL_TEXTURE_2D, colorTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  
+  glBindTexture(GL_TEXTURE_2D, depthTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTex, 0);
+}
+
+void Foveation::release()
+{
+  if(!framebuf)
+    return;
+  glDeleteTextures(1, &colorTex);
+  glDeleteTextures(1, &depthTex);
+  glDeleteFramebuffers(1, &framebuf);
+  framebuf = colorTex = depthTex = 0;
+}
+
+glm::vec2 Foveation::begin(glm::vec2 size, float density)
+{
+  int w = std::max(1, static_cast<int>(std::ceil(size.x*density)));
+  int h = std::max(1, static_cast<int>(std::ceil(size.y*density)));
+  if(w != bufWidth || h != bufHeight)
+  {
+    createTargets(w, h);
+  }
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+  return glm::vec2(w, h);
+}
+
+GLuint Foveation::getDepthBuf()
+{
+  return depthTex;
+}
+
+void Foveation::resolve(glm::vec2 size, glm::vec2 gazePoint, float density, GLuint outputDepthBuf, int direction)
+{
+  // the march wrote its depths through image stores
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glViewport(0, 0, size.x, size.y);
+  
+  resolveShader->bind();
+  
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, colorTex);
+  glUniform1i(resolveShader->getUniform("foveaColor"), 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, depthTex);
+  glUniform1i(resolveShader->getUniform("foveaDepth"), 1);
+  glActiveTexture(GL_TEXTURE0);
+  
+  glBindImageTexture(1, outputDepthBuf, 0, GL_FALSE, direction, GL_WRITE_ONLY, GL_R32F);
+  glUniform1i(resolveShader->getUniform("outputDepthBuffer"), 1);
+  glUniform1i(resolveShader->getUniform("writeDepth"), outputDepthBuf != 0);
+  
+  glUniform2f(resolveShader->getUniform("resolution"), size.x, size.y);
+  glUniform2f(resolveShader->getUniform("bufferResolution"), static_cast<float>(bufWidth), static_cast<float>(bufHeight));
+  glUniform2f(resolveShader->getUniform("gazePoint"), gazePoint.x, gazePoint.y);
+  glUniform1f(resolveShader->getUniform("foveaDensity"), density);
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  
+  resolveShader->unbind();
+}
@@ -0,0 +1,38 @@
+#ifndef __FOVEATION_H
+#define __FOVEATION_H
+
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Program.h"
+
+// A reduced resolution target for foveated marching. Along each axis the
+// target is warped around the gaze point, so the fovea keeps full pixel
+// density while the periphery gets squeezed into fewer pixels. `resolve`
+// unwarps the result back into a full resolution framebuffer.
+class Foveation
+{
+  GLuint framebuf = 0, colorTex = 0, depthTex = 0;
+  int bufWidth = 0, bufHeight = 0;
+  std::shared_ptr<Program> resolveShader;
+  
+  void createTargets(int w, int h);
+  void release();
+public:
+  void init(const std::string &resourceDirectory);
+  ~Foveation();
+  
+  // sizes and binds the warped target for an output of `size`, where
+  // `density` is the fraction of pixels kept along each axis
+  // Returns the size of the warped target
+  glm::vec2 begin(glm::vec2 size, float density);
+  
+  GLuint getDepthBuf();
+  
+  // unwarps the last march into the bound framebuffer, and into layer
+  // `direction` of `outputDepthBuf` when it is set
+  void resolve(glm::vec2 size, glm::vec2 gazePoint, float density, GLuint outputDepthBuf, int direction);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "GBuffer.h"
+
+GBuffer::~GBuffer()
+{
+  for(auto &entry : views)
+  {
+    release(entry.second);
+  }
+}
+
+void GBuffer::release(View &v)
+{
+  if(v.normalTex)
+  {
+    glDeleteTextures(1, &v.normalTex);
+    glDeleteTextures(1, &v.materialTex);
+    glDeleteTextures(1, &v.depthTex);
+  }
+  v.normalTex = v.materialTex = v.depthTex = 0;
+}
+
+GBuffer::View &GBuffer::view(int key, glm::vec2 size)
+{
+  View &v = views[key];
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  if(v.width == w && v.height == h)
+    return v;
+  
+  release(v);
+  v.width = w;
+  v.height = h;
+  v.valid = false;
+  
+  glGenTextures(1, &v.normalTex);
+  glGenTextures(1, &v.materialTex);
+  glGenTextures(1, &v.depthTex);
+  
+  glBindTexture(GL_TEXTURE_2D, v.normalTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, w, h);
+  glBindTexture(GL_TEXTURE_2D, v.materialTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, w, h);
+  glBindTexture(GL_TEXTURE_2D, v.depthTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  
+  return v;
+}
@@ -0,0 +1,38 @@
+#ifndef __GBUFFER_H
+#define __GBUFFER_H
+
+#include <map>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+// Surface terms of the last march of each direct view, keyed as the
+// interleaving histories are, so color edits only need shading again.
+// Layers keep their own, alongside their faces.
+class GBuffer
+{
+public:
+  struct View
+  {
+    GLuint normalTex = 0, materialTex = 0, depthTex = 0;
+    int width = 0, height = 0;
+    bool valid = false;
+    
+    // what the march was made with
+    int geometryRevision = -1;
+    glm::dvec3 pos;
+    double zoom = 0.;
+    glm::vec3 forward, up;
+  };
+  
+  ~GBuffer();
+  
+  // the view under `key`, reallocated and invalidated when `size` changed
+  View &view(int key, glm::vec2 size);
+  
+private:
+  std::map<int, View> views;
+  
+  void release(View &v);
+};
+
+#endif
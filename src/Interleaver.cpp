@@ -0,0 +1,205 @@
+#include "Interleaver.h"
+
+#include <iostream>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+// for the unit plane
+#include "MandelRenderer.h"
+
+void Interleaver::init(const std::string &resourceDirectory)
+{
+  resolveShader = std::make_shared<Program>();
+  resolveShader->setVerbose(true);
+  resolveShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/interleave_resolve.fs");
+  if (!resolveShader->init())
+  {
+    std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+    exit(1);
+  }
+  resolveShader->addAttribute("vertPos");
+  resolveShader->addUniform("currentColor");
+  resolveShader->addUniform("currentDepth");
+  resolveShader->addUniform("historyColor");
+  resolveShader->addUniform("historyDepth");
+  resolveShader->addUniform("historyValid");
+  resolveShader->addUniform("interleave");
+  resolveShader->addUniform("interleavePhase");
+  resolveShader->addUniform("resolution");
+  resolveShader->addUniform("fle");
+  resolveShader->addUniform("camRight");
+  resolveShader->addUniform("camUp");
+  resolveShader->addUniform("camForward");
+  resolveShader->addUniform("zoomLevel");
+  resolveShader->addUniform("originShift");
+  resolveShader->addUniform("prevRight");
+  resolveShader->addUniform("prevUp");
+  resolveShader->addUniform("prevForward");
+  resolveShader->addUniform("prevZoomLevel");
+  resolveShader->addUniform("historyColorOut");
+  resolveShader->addUniform("historyDepthOut");
+  resolveShader->addUniform("outputDepthBuffer");
+  resolveShader->addUniform("writeDepth");
+}
+
+void Interleaver::release(History &h)
+{
+  if(h.colorTex[0])
+  {
+    glDeleteTextures(2, h.colorTex);
+    glDeleteTextures(2, h.depthTex);
+  }
+  h.colorTex[0] = h.colorTex[1] = h.depthTex[0] = h.depthTex[1] = 0;
+}
+
+Interleaver::~Interleaver()
+{
+  for(auto &entry : histories)
+  {
+    release(entry.second);
+  }
+  if(framebuf)
+  {
+    glDeleteTextures(1, &colorTex);
+    glDeleteTextures(1, &depthTex);
+    glDeleteFramebuffers(1, &framebuf);
+  }
+}
+
+int Interleaver::begin(int key, glm::vec2 size, int interleave)
+{
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  
+  // the sparse march target is shared, and only ever grows
+  if(w > width || h > height)
+  {
+    if(framebuf)
+    {
+      glDeleteTextures(1, &colorTex);
+      glDeleteTextures(1, &depthTex);
+      glDeleteFramebuffers(1, &framebuf);
+    }
+    width = std::max(w, width);
+    height = std::max(h, height);
+    
+    glGenTextures(1, &colorTex);
+    glGenTextures(1, &depthTex);
+    glGenFramebuffers(1, &framebuf);
+    
+    glBindTexture(GL_TEXTURE_2D, colorTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glBindTexture(GL_TEXTURE_2D, depthTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTex, 0);
+  }
+  
+  // histories have to match their view exactly
+  History &hist = histories[key];
+  if(hist.width != w || hist.height != h)
+  {
+    release(hist);
+    hist.width = w;
+    hist.height = h;
+    hist.valid = false;
+    
+    glGenTextures(2, hist.colorTex);
+    glGenTextures(2, hist.depthTex);
+    for(int i = 0; i < 2; i++)
+    {
+      glBindTexture(GL_TEXTURE_2D, hist.colorTex[i]);
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+      glBindTexture(GL_TEXTURE_2D, hist.depthTex[i]);
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, w, h);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  if(hist.interleave != interleave)
+  {
+    hist.interleave = interleave;
+    hist.phase = 0;
+  }
+  else
+  {
+    hist.phase = (hist.phase + 1) % interleave;
+  }
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+  return hist.phase;
+}
+
+GLuint Interleaver::getDepthBuf()
+{
+  return depthTex;
+}
+
+void Interleaver::resolve(int key, glm::vec2 size, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, float fle, GLuint outputDepthBuf, int direction)
+{
+  History &hist = histories[key];
+  int next = 1 - hist.current;
+  
+  // depths, and the last history, were written through image stores
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glViewport(0, 0, size.x, size.y);
+  
+  resolveShader->bind();
+  
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, colorTex);
+  glUniform1i(resolveShader->getUniform("currentColor"), 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, depthTex);
+  glUniform1i(resolveShader->getUniform("currentDepth"), 1);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, hist.colorTex[hist.current]);
+  glUniform1i(resolveShader->getUniform("historyColor"), 2);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D, hist.depthTex[hist.current]);
+  glUniform1i(resolveShader->getUniform("historyDepth"), 3);
+  glActiveTexture(GL_TEXTURE0);
+  glUniform1i(resolveShader->getUniform("historyValid"), hist.valid);
+  
+  glBindImageTexture(1, outputDepthBuf, 0, GL_FALSE, direction, GL_WRITE_ONLY, GL_R32F);
+  glUniform1i(resolveShader->getUniform("outputDepthBuffer"), 1);
+  glUniform1i(resolveShader->getUniform("writeDepth"), outputDepthBuf != 0);
+  glBindImageTexture(2, hist.colorTex[next], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+  glUniform1i(resolveShader->getUniform("historyColorOut"), 2);
+  glBindImageTexture(3, hist.depthTex[next], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  glUniform1i(resolveShader->getUniform("historyDepthOut"), 3);
+  
+  glUniform1i(resolveShader->getUniform("interleave"), hist.interleave);
+  glUniform1i(resolveShader->getUniform("interleavePhase"), hist.phase);
+  glUniform2f(resolveShader->getUniform("resolution"), size.x, size.y);
+  glUniform1f(resolveShader->getUniform("fle"), fle);
+  
+  // the same basis the march builds its rays from
+  glm::vec3 right = glm::normalize(glm::cross(forward, up));
+  glm::vec3 trueUp = glm::cross(right, forward);
+  glUniform3fv(resolveShader->getUniform("camRight"), 1, glm::value_ptr(right));
+  glUniform3fv(resolveShader->getUniform("camUp"), 1, glm::value_ptr(trueUp));
+  glUniform3fv(resolveShader->getUniform("camForward"), 1, glm::value_ptr(forward));
+  glUniform1f(resolveShader->getUniform("zoomLevel"), static_cast<float>(zoomLevel));
+  
+  glm::vec3 prevRight = glm::normalize(glm::cross(hist.forward, hist.up));
+  glm::vec3 prevUp = glm::cross(prevRight, hist.forward);
+  glm::vec3 shift(pos/zoomLevel - hist.pos/hist.zoomLevel);
+  glUniform3fv(resolveShader->getUniform("originShift"), 1, glm::value_ptr(shift));
+  glUniform3fv(resolveShader->getUniform("prevRight"), 1, glm::value_ptr(prevRight));
+  glUniform3fv(resolveShader->getUniform("prevUp"), 1, glm::value_ptr(prevUp));
+  glUniform3fv(resolveShader->getUniform("prevForward"), 1, glm::value_ptr(hist.forward));
+  glUniform1f(resolveShader->getUniform("prevZoomLevel"), static_cast<float>(hist.zoomLevel));
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  
+  resolveShader->unbind();
+  
+  hist.current = next;
+  hist.valid = true;
+  hist.pos = pos;
+  hist.forward = forward;
+  hist.up = up;
+  hist.zoomLevel = zoomLevel;
+}
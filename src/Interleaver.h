@@ -0,0 +1,53 @@
+#ifndef __INTERLEAVER_H
+#define __INTERLEAVER_H
+
+#include <memory>
+#include <string>
+#include <map>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Program.h"
+
+// Amortized marching: each frame only 1 in 2 or 4 pixels gets marched, in
+// a rotating pattern, and the rest are reprojected from the previous frame.
+// Every view being marched keeps its own history, under a key of its own.
+class Interleaver
+{
+  struct History
+  {
+    // ping-ponged, `current` being the one holding the last frame
+    GLuint colorTex[2] = {0, 0}, depthTex[2] = {0, 0};
+    int current = 0;
+    int width = 0, height = 0;
+    int interleave = 0, phase = 0;
+    bool valid = false;
+    
+    // positions in doubles, only their difference goes to the GPU
+    glm::dvec3 pos = glm::dvec3(0);
+    glm::vec3 forward = glm::vec3(0, 0, -1), up = glm::vec3(0, 1, 0);
+    double zoomLevel = 1.;
+  };
+  std::map<int, History> histories;
+  
+  GLuint framebuf = 0, colorTex = 0, depthTex = 0;
+  int width = 0, height = 0;
+  std::shared_ptr<Program> resolveShader;
+  
+  void release(History &h);
+public:
+  void init(const std::string &resourceDirectory);
+  ~Interleaver();
+  
+  // binds the target the sparse march goes into, and returns the slot of
+  // the pattern to march this frame
+  int begin(int key, glm::vec2 size, int interleave);
+  // the march writes its depths here
+  GLuint getDepthBuf();
+  
+  // fills in the skipped pixels into the bound framebuffer, and into layer
+  // `direction` of `outputDepthBuf` when set. The camera is the one the
+  // march used, the history then moves on to this frame
+  void resolve(int key, glm::vec2 size, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, float fle, GLuint outputDepthBuf, int direction);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "LayerPool.h"
+
+#include <cmath>
+
+bool LayerPool::Layout::operator==(const Layout &other) const
+{
+  return width == other.width && height == other.height && sides == other.sides
+    && color == other.color && depth == other.depth;
+}
+
+bool LayerPool::Layout::operator!=(const Layout &other) const
+{
+  return !(*this == other);
+}
+
+const std::vector<LayerPool::FormatInfo> &LayerPool::colorFormats()
+{
+  // the float one has 5 bits of mantissa in blue, so rounds by 2^-7 just
+  // below 1
+  static const std::vector<FormatInfo> formats = {
+    { GL_RGBA8, "RGBA8", 4, .5f },
+    { GL_RGB10_A2, "RGB10 A2", 4, .5f*255.f/1023.f },
+    { GL_R11F_G11F_B10F, "R11G11B10 float", 4, 255.f/128.f },
+    { GL_RGB565, "RGB565", 2, .5f*255.f/31.f },
+  };
+  return formats;
+}
+
+const std::vector<LayerPool::FormatInfo> &LayerPool::depthFormats()
+{
+  // packed depths round down, by up to a whole step
+  static const std::vector<FormatInfo> formats = {
+    { GL_R32F, "32 bit float", 4, std::exp2(-24.f) },
+    { GL_R16_SNORM, "16 bit log", 2, std::exp2((PACKED_DEPTH_LOG_MAX - PACKED_DEPTH_LOG_MIN)/32767.f) - 1.f },
+  };
+  return formats;
+}
+
+const LayerPool::FormatInfo &LayerPool::formatInfo(GLenum format)
+{
+  for(const FormatInfo &info : depthFormats())
+  {
+    if(info.format == format)
+      return info;
+  }
+  for(const FormatInfo &info : colorFormats())
+  {
+    if(info.format == format)
+      return info;
+  }
+  return colorFormats().front();
+}
+
+void LayerPool::init(GLuint stencil)
+{
+  stencilID = stencil;
+}
+
+LayerPool::~LayerPool()
+{
+  for(Faces &faces : idle)
+    destroy(faces);
+}
+
+LayerPool::Faces LayerPool::allocate(const Layout &layout)
+{
+  int w = layout.width, h = layout.height, sides = layout.sides;
+  Faces faces;
+  faces.layout = layout;
+  glGenTextures(1, &faces.color);
+  glGenTextures(1, &faces.depth);
+  glGenTextures(1, &faces.normal);
+  glGenTextures(1, &faces.material);
+  glGenFramebuffers(NUM_SIDES, faces.framebufs.data());
+  glGenFramebuffers(1, &faces.layeredFramebuf);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, faces.color);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, layout.color, w, h, sides);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, faces.depth);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, layout.depth, w, h, sides);
+  // depths are not interpolated across silhouettes when reprojecting
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  // only ever accessed as images
+  glBindTexture(GL_TEXTURE_2D_ARRAY, faces.normal);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA16F, w, h, sides);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, faces.material);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA16F, w, h, sides);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  GLint previous;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  // single maps outgrow the stencil, which would crop what they draw to
+  // its size
+  bool cube = sides == NUM_SIDES;
+  for(int i = 0; i < sides; i++)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, faces.framebufs[i]);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, faces.color, 0, i);
+    if(cube)
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, stencilID, 0, i);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, faces.layeredFramebuf);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, faces.color, 0);
+  if(cube)
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, stencilID, 0);
+  // made between frames as well, so whatever was being drawn to stays bound
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+  return faces;
+}
+
+void LayerPool::destroy(Faces &faces)
+{
+  glDeleteTextures(1, &faces.color);
+  glDeleteTextures(1, &faces.depth);
+  glDeleteTextures(1, &faces.normal);
+  glDeleteTextures(1, &faces.material);
+  glDeleteFramebuffers(NUM_SIDES, faces.framebufs.data());
+  glDeleteFramebuffers(1, &faces.layeredFramebuf);
+  faces = Faces();
+}
+
+size_t LayerPool::bytesOf(const Faces &faces)
+{
+  // color, depth and the two g-buffer halves
+  const Layout &layout = faces.layout;
+  size_t perTexel = formatInfo(layout.color).bytes + formatInfo(layout.depth).bytes + 8 + 8;
+  return static_cast<size_t>(layout.width)*layout.height*layout.sides*perTexel;
+}
+
+LayerPool::Faces LayerPool::acquire(const Layout &layout)
+{
+  Faces faces;
+  bool found = false;
+  for(auto i = idle.begin(); i != idle.end(); i++)
+  {
+    if(i->layout == layout)
+    {
+      faces = *i;
+      idle.erase(i);
+      found = true;
+      break;
+    }
+  }
+  if(!found)
+    faces = allocate(layout);
+  used += bytesOf(faces);
+  return faces;
+}
+
+void LayerPool::release(Faces &faces)
+{
+  if(!faces.color)
+    return;
+  used -= bytesOf(faces);
+  idle.push_back(faces);
+  faces = Faces();
+}
+
+void LayerPool::prepare(const std::vector<Layout> &layouts)
+{
+  wanted = layouts;
+}
+
+int LayerPool::idleCount(const Layout &layout)
+{
+  int count = 0;
+  for(Faces &faces : idle)
+    count += faces.layout == layout;
+  return count;
+}
+
+int LayerPool::wantedCount(const Layout &layout)
+{
+  int count = 0;
+  for(Layout &w : wanted)
+    count += w == layout;
+  return count;
+}
+
+void LayerPool::update()
+{
+  // one allocation a frame keeps the driver from stalling any of them
+  for(Layout &layout : wanted)
+  {
+    if(idleCount(layout) < wantedCount(layout))
+    {
+      idle.push_back(allocate(layout));
+      return;
+    }
+  }
+
+  // the same for freeing what nobody is waiting on, oldest first
+  int spare = static_cast<int>(idle.size()) - static_cast<int>(wanted.size()) - max_idle;
+  for(auto i = idle.begin(); i != idle.end() && spare > 0; i++)
+  {
+    if(idleCount(i->layout) > wantedCount(i->layout))
+    {
+      destroy(*i);
+      idle.erase(i);
+      return;
+    }
+  }
+}
+
+size_t LayerPool::usedBytes()
+{
+  return used;
+}
+
+size_t LayerPool::idleBytes()
+{
+  size_t total = 0;
+  for(Faces &faces : idle)
+    total += bytesOf(faces);
+  return total;
+}
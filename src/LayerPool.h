@@ -0,0 +1,101 @@
+#ifndef __LAYERPOOL_H
+#define __LAYERPOOL_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <glad/glad.h>
+
+#include "directions.h"
+
+// Face storage for the onion layers: the color, depth and g-buffer arrays
+// of all six faces, and the framebuffers drawing into them. Layers give
+// theirs back when they go or change size, and the next one asking for the
+// same size gets it again, so changing depth doesn't go through the driver.
+// Storage the next change is likely to need can be asked for ahead of time,
+// and gets made a set per frame in `update`.
+class LayerPool
+{
+public:
+  // the size and formats of a set
+  struct Layout
+  {
+    int width = 0, height = 0;
+    // layers of each array, NUM_SIDES for cube faces, 1 for a single map
+    // of every direction
+    int sides = NUM_SIDES;
+    GLenum color = GL_RGBA8;
+    // GL_R32F, or GL_R16_SNORM holding the log2 of the distances over
+    // [PACKED_DEPTH_LOG_MIN, PACKED_DEPTH_LOG_MAX], which only the march
+    // programs built with PACKED_DEPTH write
+    GLenum depth = GL_R32F;
+    bool operator==(const Layout &other) const;
+    bool operator!=(const Layout &other) const;
+  };
+
+  struct Faces
+  {
+    GLuint color = 0, depth = 0, normal = 0, material = 0;
+    std::array<GLuint, NUM_SIDES> framebufs = {};
+    // all faces at once, for marching them in a single draw
+    GLuint layeredFramebuf = 0;
+    Layout layout;
+  };
+
+  // a format faces can be stored in. `error` is the worst rounding of a
+  // color in steps of an 8 bit display, and of a depth relative to it
+  struct FormatInfo
+  {
+    GLenum format;
+    const char *name;
+    int bytes;
+    float error;
+  };
+  static const std::vector<FormatInfo> &colorFormats();
+  static const std::vector<FormatInfo> &depthFormats();
+  static const FormatInfo &formatInfo(GLenum format);
+
+  // the world distances packed depths cover, as powers of two. Nearer ones
+  // read as this near, further ones as the sky
+  static constexpr float PACKED_DEPTH_LOG_MIN = -32.f;
+  static constexpr float PACKED_DEPTH_LOG_MAX = 64.f;
+
+  // idle sets kept past what was last asked to be ready
+  int max_idle = 2;
+
+  // `stencil` gets attached to the framebuffers of every set of cube
+  // faces, and has to cover the largest size asked for
+  void init(GLuint stencil);
+  ~LayerPool();
+
+  // an idle set of that layout, or a new one
+  Faces acquire(const Layout &layout);
+  // takes `faces` back for reuse, leaving it empty
+  void release(Faces &faces);
+
+  // the layouts that should have an idle set waiting, replacing the last
+  // ones asked for
+  void prepare(const std::vector<Layout> &layouts);
+  // makes at most one of the prepared sets, or frees one idle set nobody
+  // asked for. Once a frame
+  void update();
+
+  // bytes of the sets handed out, and of the idle ones
+  size_t usedBytes();
+  size_t idleBytes();
+
+private:
+  GLuint stencilID = 0;
+  std::vector<Faces> idle;
+  std::vector<Layout> wanted;
+  size_t used = 0;
+
+  Faces allocate(const Layout &layout);
+  void destroy(Faces &faces);
+  static size_t bytesOf(const Faces &faces);
+  // idle sets of that layout, and the ones `wanted` asks for
+  int idleCount(const Layout &layout);
+  int wantedCount(const Layout &layout);
+};
+
+#endif
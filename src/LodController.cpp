@@ -0,0 +1,59 @@
+#include "LodController.h"
+
+#include <cmath>
+#include <algorithm>
+
+int LodController::settle(int current, float ideal, float hysteresis)
+{
+  if(std::abs(ideal - current) <= .5f + hysteresis)
+    return current;
+  return static_cast<int>(std::round(ideal));
+}
+
+void LodController::update(float zoomLevel, float height, MandelRenderer::RenderData &dat)
+{
+  if(!enabled)
+    return;
+  
+  float logPower = std::log(static_cast<float>(std::max(dat.modulo, 2)));
+  // powers of the bulb zoomed in by, and the angle across a pixel
+  float zoomPowers = std::max(std::log(std::max(zoomLevel, 1.f))/logPower, 0.f);
+  float footprint = 2.f/(std::max(dat.fle, 1e-3f)*std::max(height, 1.f));
+  
+  // features a pixel across at unit distance, in fractal space
+  float resolvable = std::log(std::max(zoomLevel, 1.f)/footprint)/logPower;
+  idealIterations = std::max(quality*resolvable, 1.f) + iteration_bias;
+  idealIterations = std::min(idealIterations, static_cast<float>(max_iterations));
+  dat.map_iter_count = settle(dat.map_iter_count, idealIterations, hysteresis);
+  
+  // a layer for every power zoomed in by
+  idealLayers = std::min(1.f + zoomPowers, static_cast<float>(max_layers));
+  layerCount = std::max(settle(layerCount, idealLayers, hysteresis), 1);
+  
+  // the threshold already scales with the pixel footprint in the shader,
+  // only the quality is left to it
+  dat.intersect_threshold = base_threshold/std::max(quality, 1e-2f);
+  
+  // finer surfaces take smaller steps to reach, so more of them
+  float idealSteps = base_step_count*quality*(1.f + step_growth*zoomPowers);
+  idealSteps = std::min(std::max(idealSteps, 16.f), 1024.f);
+  // steps move in whole eighths of the base count
+  float unit = std::max(base_step_count/8.f, 1.f);
+  int steps = settle(static_cast<int>(std::round(dat.intersect_step_count/unit)), idealSteps/unit, hysteresis);
+  dat.intersect_step_count = std::max(static_cast<int>(steps*unit), 1);
+}
+
+int LodController::layers()
+{
+  return layerCount;
+}
+
+float LodController::iterationTarget()
+{
+  return idealIterations;
+}
+
+float LodController::layerTarget()
+{
+  return idealLayers;
+}
@@ -0,0 +1,46 @@
+#ifndef __LODCONTROLLER_H
+#define __LODCONTROLLER_H
+
+#include "MandelRenderer.h"
+
+// Picks the level of detail from the zoom level and the size of a pixel.
+// A bulb of power p gains detail p times finer with every iteration of its
+// map, so a view resolving features `f` across needs about log_p(1/f) of
+// them. Each output only moves once its ideal value leaves a band around
+// where it is, so zooming doesn't reallocate layers every frame.
+class LodController
+{
+  // the ideal values before rounding, kept for the readout
+  float idealIterations = 0.f, idealLayers = 0.f;
+  int layerCount = 1;
+  
+  // `current` moved to `ideal` once they are further apart than the band
+  static int settle(int current, float ideal, float hysteresis);
+public:
+  bool enabled = false;
+  // quality against performance, 1 being the settings the renderer
+  // ships with at zoom level 1
+  float quality = 1.f;
+  // the settings at zoom level 1 and quality 1
+  float base_threshold = 0.0025f;
+  int base_step_count = 128;
+  // iterations on top of what the pixels can resolve
+  int iteration_bias = 1;
+  int max_iterations = 32;
+  int max_layers = 8;
+  // extra steps per power the zoom grows by, as a fraction of the base
+  float step_growth = .25f;
+  // fraction of a step past the halfway point an output has to be off by
+  // before it changes
+  float hysteresis = .25f;
+  
+  // sets the iteration count, threshold and step count of `dat` for a view
+  // `height` pixels tall. Does nothing unless enabled
+  void update(float zoomLevel, float height, MandelRenderer::RenderData &dat);
+  // onion layers the zoom level calls for
+  int layers();
+  float iterationTarget();
+  float layerTarget();
+};
+
+#endif
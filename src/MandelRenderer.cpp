@@ -38,16 +38,25 @@ void MandelRenderer::init()
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 }
 
-void MandelRenderer::render(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, float zoomLevel, glm::vec2 size, bool exhaust)
+void MandelRenderer::render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, bool exhaust, float scale, int historyKey)
 {
   // this is probably real inefficient oops
   RenderData d2 = data;
   d2.zoom_level = zoomLevel;
   d2.exhaust = exhaust;
+  d2.resolution_scale = scale;
+  d2.gaze_dir = gazeDirection(forward, up, size);
+  d2.history_key = historyKey;
   render_internal(prog, pos, forward, up, size, d2);
 }
   
-void MandelRenderer::render(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, float zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot)
+void MandelRenderer::render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData dat)
+{
+  dat.gaze_dir = gazeDirection(forward, up, size);
+  render_internal(prog, pos, forward, up, size, dat);
+}
+
+MandelRenderer::RenderData MandelRenderer::faceData(double zoomLevel, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot, glm::vec3 gazeDir, float scale)
 {
   RenderData d2 = data;
   d2.zoom_level = zoomLevel;
@@ -56,37 +65,553 @@ void MandelRenderer::render(std::shared_ptr<Program> prog, glm::vec3 pos, glm::v
   d2.depthbufferInput = inputDepthBuf;
   d2.depthbufferOutput = marcher.getMarchDepthBuf();
   d2.direction = direction;
+  // cube faces have to cover exactly 90 degrees to tile, and reprojection
+  // relies on it too
+  d2.fle = 1.;
+  d2.gaze_dir = gazeDir;
+  d2.resolution_scale = scale;
+  d2.collect_stats = 1;
+  const MarchingLayer::Pass &pass = marcher.getPass();
+  d2.pass_command = pass.index;
+  d2.next_pass = pass.next;
+  d2.packed_depth = marcher.packsDepth();
+  if(pass.continues)
+  {
+    d2.continue_rays = 1;
+    d2.band_far = pass.bandFar;
+    d2.intersect_step_count = pass.stepBudget;
+  }
+  d2.history_key = FACE_HISTORY_KEYS + marcher.mappinglevel*NUM_SIDES + direction;
+  // the warps and reprojections in between all assume a pinhole
+  if(marcher.isOctahedral())
+  {
+    d2.octahedral = 1;
+    d2.foveated = 0;
+    d2.interleave = 1;
+    d2.edge_upsample = 0;
+  }
+  if(data.deferred)
+  {
+    d2.gbuffer_normal = marcher.getGBufNormal();
+    d2.gbuffer_material = marcher.getGBufMaterial();
+  }
+  return d2;
+}
+
+void MandelRenderer::render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot, glm::vec3 gazeDir, float scale)
+{
+  RenderData d2 = faceData(zoomLevel, marcher, inputDepthBuf, direction, isRoot, gazeDir, scale);
   render_internal(prog, pos, forward, up, size, d2);
 }
 
-void MandelRenderer::render_internal(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+bool MandelRenderer::canRenderFaces()
+{
+  // the ladder can't fall back to a rung it would skip otherwise
+  return layeredPrograms[PRECISION_FLOAT]
+    && (!df64Program || layeredPrograms[PRECISION_DF64])
+    && (!fp64Program || layeredPrograms[PRECISION_FP64]);
+}
+
+bool MandelRenderer::canPackDepth()
+{
+  return canRenderFaces() && packedPrograms[PRECISION_FLOAT]
+    && (!df64Program || packedPrograms[PRECISION_DF64])
+    && (!fp64Program || packedPrograms[PRECISION_FP64]);
+}
+
+void MandelRenderer::renderFaces(std::shared_ptr<Program> prog, glm::dvec3 pos, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, bool isRoot)
+{
+  RenderData d2 = faceData(zoomLevel, marcher, inputDepthBuf, 0, isRoot, glm::vec3(0, 0, -1), 1.f);
+  d2.layered = 1;
+  glViewport(0, 0, size.x, size.y);
+  glClearColor(0.f, 1.f, 0.f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  // the shader takes each face's basis from its own table, the one passed
+  // here goes unused
+  march(prog, pos, glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), size, size, glm::vec2(0), d2);
+}
+
+void MandelRenderer::renderLayerOverlay(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, bool isRoot)
+{
+  RenderData d2 = data;
+  d2.zoom_level = zoomLevel;
+  d2.map_iter_count = marcher.mappinglevel;
+  d2.exhaust = isRoot;
+  d2.gaze_dir = gazeDirection(forward, up, size);
+  // overlays are drawn on top of other views, so have no history of their own
+  d2.interleave = 1;
+  render_internal(prog, pos, forward, up, size, d2, false);
+}
+
+void MandelRenderer::renderTile(std::shared_ptr<Program> prog, glm::dvec3 pos, int direction, double zoomLevel, int mapIterCount, glm::vec2 size, glm::vec2 origin, glm::vec2 slot, int tileSize)
+{
+  RenderData d2 = data;
+  d2.zoom_level = zoomLevel;
+  d2.map_iter_count = mapIterCount;
+  d2.exhaust = 1;
+  d2.fle = 1.;
+  // the rays are cast as if the whole face was being drawn, the viewport
+  // only letting the tile through
+  d2.jitter = origin - slot;
+  d2.interleave = 1;
+  d2.foveated = 0;
+  glViewport(slot.x, slot.y, tileSize, tileSize);
+  march(prog, pos, dirEnumToDirection(direction), dirEnumToUp(direction), size, size, glm::vec2(0), d2);
+}
+
+MandelRenderer::RenderData MandelRenderer::faceShadeData(double zoomLevel, MarchingLayer &marcher, int direction)
+{
+  RenderData d2 = data;
+  d2.zoom_level = zoomLevel;
+  d2.direction = direction;
+  d2.fle = 1.;
+  d2.shade_only = 1;
+  d2.gbuffer_normal = marcher.getGBufNormal();
+  d2.gbuffer_material = marcher.getGBufMaterial();
+  d2.gbuffer_depth = marcher.getMarchDepthBuf();
+  d2.packed_depth = marcher.packsDepth();
+  d2.octahedral = marcher.isOctahedral();
+  d2.interleave = 1;
+  d2.foveated = 0;
+  return d2;
+}
+
+void MandelRenderer::reshade(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, int direction)
 {
+  RenderData d2 = faceShadeData(zoomLevel, marcher, direction);
   glViewport(0, 0, size.x, size.y);
+  glClearColor(0.f, 1.f, 0.f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  march(prog, pos, forward, up, size, size, glm::vec2(0), d2);
+}
+
+void MandelRenderer::reshadeFaces(std::shared_ptr<Program> prog, glm::dvec3 pos, double zoomLevel, glm::vec2 size, MarchingLayer &marcher)
+{
+  RenderData d2 = faceShadeData(zoomLevel, marcher, 0);
+  d2.layered = 1;
+  glViewport(0, 0, size.x, size.y);
+  glClearColor(0.f, 1.f, 0.f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  march(prog, pos, glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), size, size, glm::vec2(0), d2);
+}
+
+// FNV-1a, over the bytes of each field in turn
+static void hashField(uint64_t &h, const void *field, size_t bytes)
+{
+  const unsigned char *b = static_cast<const unsigned char*>(field);
+  for(size_t i = 0; i < bytes; i++)
+  {
+    h ^= b[i];
+    h *= 1099511628211ull;
+  }
+}
+
+#define HASH(h, field) hashField(h, &(field), sizeof(field))
+
+MandelRenderer::RenderData::Hashes MandelRenderer::RenderData::hash() const
+{
+  Hashes h;
+  h.geometry = h.shading = h.display = h.time = 14695981039346656037ull;
+  
+  // anything the surface, its normals or its shadows depend on
+  HASH(h.geometry, intersect_threshold);
+  HASH(h.geometry, intersect_step_count);
+  HASH(h.geometry, intersect_step_factor);
+  HASH(h.geometry, zoom_level);
+  HASH(h.geometry, map_start_offset);
+  HASH(h.geometry, fle);
+  HASH(h.geometry, modulo);
+  HASH(h.geometry, map_iter_count);
+  HASH(h.geometry, juliaFactor);
+  HASH(h.geometry, juliaPoint);
+  HASH(h.geometry, exhaust);
+  HASH(h.geometry, movingJulia);
+  HASH(h.geometry, shadow_steps);
+  HASH(h.geometry, shadow_sharpness);
+  HASH(h.geometry, footprint_bias);
+  HASH(h.geometry, extended_precision);
+  HASH(h.geometry, df64_footprint);
+  HASH(h.geometry, fp64_footprint);
+  
+  // what gets applied on top of a g-buffer
+  HASH(h.shading, clear_color);
+  HASH(h.shading, y_color);
+  HASH(h.shading, z_color);
+  HASH(h.shading, w_color);
+  HASH(h.shading, diff1);
+  HASH(h.shading, diff2);
+  HASH(h.shading, diff3);
+  HASH(h.shading, doFog);
   
-  glm::mat4 view = glm::lookAt(pos, pos + forward, up);
+  // how frames get drawn, what is already marched stays as it is
+  HASH(h.display, foveated);
+  HASH(h.display, gaze);
+  HASH(h.display, fovea_density);
+  HASH(h.display, fovea_step_falloff);
+  HASH(h.display, fovea_iter_falloff);
+  HASH(h.display, edge_upsample);
+  HASH(h.display, guide_iter_drop);
+  HASH(h.display, interleave);
+  HASH(h.display, temporal_seed);
+  HASH(h.display, seed_fraction);
+  HASH(h.display, deferred);
+  
+  HASH(h.time, time);
+  return h;
+}
+
+bool MandelRenderer::RenderData::juliaMoves() const
+{
+  return movingJulia && juliaFactor > 0.f;
+}
+
+#undef HASH
+
+int MandelRenderer::diff(const RenderData::Hashes &a, const RenderData::Hashes &b)
+{
+  int mask = 0;
+  if(a.geometry != b.geometry)
+    mask |= DIRTY_GEOMETRY;
+  if(a.shading != b.shading)
+    mask |= DIRTY_SHADING;
+  if(a.display != b.display)
+    mask |= DIRTY_DISPLAY;
+  if(a.time != b.time)
+    mask |= DIRTY_TIME;
+  return mask;
+}
+
+int MandelRenderer::updateRevisions()
+{
+  RenderData::Hashes now = data.hash();
+  if(!haveLastHashes)
+  {
+    lastHashes = now;
+    haveLastHashes = true;
+    dirty_mask = 0;
+    return dirty_mask;
+  }
+  
+  dirty_mask = diff(now, lastHashes);
+  // the time only shows while the julia point moves
+  if((dirty_mask & DIRTY_TIME) && data.juliaMoves())
+    dirty_mask |= DIRTY_GEOMETRY;
+  
+  if(dirty_mask & DIRTY_GEOMETRY)
+    geometry_revision++;
+  if(dirty_mask & DIRTY_SHADING)
+    shading_revision++;
+  if(dirty_mask & DIRTY_DISPLAY)
+    display_revision++;
+  
+  lastHashes = now;
+  return dirty_mask;
+}
+
+int MandelRenderer::dirty()
+{
+  return dirty_mask;
+}
+
+int MandelRenderer::geometryRevision()
+{
+  return geometry_revision;
+}
+
+int MandelRenderer::shadingRevision()
+{
+  return shading_revision;
+}
+
+int MandelRenderer::displayRevision()
+{
+  return display_revision;
+}
+
+int MandelRenderer::marchPrecision()
+{
+  return lastPrecision;
+}
+
+bool MandelRenderer::prepare_gbuffer(glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+{
+  // faces come with theirs already, and get reshaded by their layer
+  if(!dat.deferred || dat.history_key >= FACE_HISTORY_KEYS)
+    return false;
+  
+  GBuffer::View &view = gbuffer.view(dat.history_key, size);
+  dat.gbuffer_normal = view.normalTex;
+  dat.gbuffer_material = view.materialTex;
+  dat.gbuffer_depth = view.depthTex;
+  
+  if(view.valid && view.geometryRevision == geometry_revision
+     && view.pos == pos && view.zoom == dat.zoom_level
+     && view.forward == forward && view.up == up)
+  {
+    dat.shade_only = 1;
+    return true;
+  }
+  
+  dat.depthbufferOutput = view.depthTex;
+  dat.direction = 0;
+  view.valid = true;
+  view.geometryRevision = geometry_revision;
+  view.pos = pos;
+  view.zoom = dat.zoom_level;
+  view.forward = forward;
+  view.up = up;
+  return false;
+}
+
+// the basis here mirrors how the shader builds rays out of the view matrix
+glm::vec3 MandelRenderer::gazeDirection(glm::vec3 forward, glm::vec3 up, glm::vec2 size)
+{
+  float smallestaxis = glm::min(size.x, size.y);
+  glm::vec2 sp = (2.f*glm::vec2(data.gaze.x, data.gaze.y)*size - size)/smallestaxis;
+  glm::vec3 s = glm::normalize(glm::cross(forward, up));
+  glm::vec3 u = glm::cross(s, forward);
+  return glm::normalize(sp.x*s + sp.y*u - data.fle*forward);
+}
+
+glm::vec2 MandelRenderer::projectGaze(glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+{
+  float smallestaxis = glm::min(size.x, size.y);
+  glm::vec3 s = glm::normalize(glm::cross(forward, up));
+  glm::vec3 u = glm::cross(s, forward);
+  
+  glm::vec2 planar(glm::dot(dat.gaze_dir, s), glm::dot(dat.gaze_dir, u));
+  float z = -glm::dot(dat.gaze_dir, forward);
+  glm::vec2 sp = z > 1e-4f ? planar*dat.fle/z : planar*1e4f;
+  
+  glm::vec2 pixel = (sp*smallestaxis + size)*.5f;
+  return glm::min(glm::max(pixel, glm::vec2(0)), size);
+}
+
+void MandelRenderer::render_internal(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat, bool clear)
+{
+  if(dat.resolution_scale < 1.f && dat.edge_upsample)
+  {
+    render_upsampled(prog, pos, forward, up, size, dat);
+    return;
+  }
+  
+  // the warp moves with the gaze, so foveated marches aren't interleaved
+  if(!dat.foveated && dat.interleave > 1)
+  {
+    render_interleaved(prog, pos, forward, up, size, dat);
+    return;
+  }
+  
+  if(!dat.foveated)
+  {
+    RenderData plain = dat;
+    bool shadeOnly = prepare_gbuffer(pos, forward, up, size, plain);
+    if(!shadeOnly)
+      begin_seed(pos, forward, up, size, plain);
+    glViewport(0, 0, size.x, size.y);
+    if(clear)
+    {
+      glClearColor(0.f, 1.f, 0.f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+    march(prog, pos, forward, up, size, size, glm::vec2(0), plain);
+    if(!shadeOnly)
+      end_seed(plain);
+    return;
+  }
+  
+  glm::vec2 gazePoint = projectGaze(forward, up, size, dat);
+  
+  GLint target;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+  
+  glm::vec2 bufferSize = foveation.begin(size, dat.fovea_density);
+  glViewport(0, 0, bufferSize.x, bufferSize.y);
+  // overlays have to stay see through where nothing was resolved
+  glClearColor(0.f, clear ? 1.f : 0.f, 0.f, clear ? 1.f : 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  
+  // depths go to the warped target first, and get unwarped with the color
+  RenderData warped = dat;
+  warped.depthbufferOutput = dat.depthbufferOutput ? foveation.getDepthBuf() : 0;
+  warped.interleave = 1;
+  warped.gbuffer_normal = warped.gbuffer_material = 0;
+  march(prog, pos, forward, up, size, bufferSize, gazePoint, warped);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  foveation.resolve(size, gazePoint, dat.fovea_density, dat.depthbufferOutput, dat.direction);
+}
+
+void MandelRenderer::begin_seed(glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+{
+  // faces move too rarely for it to pay off
+  if(!dat.temporal_seed || dat.history_key >= FACE_HISTORY_KEYS)
+    return;
+  
+  GLint target;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+  dat.seed_buffer = seeder.begin(dat.history_key, size, pos, forward, up, dat.zoom_level, dat.fle, geometry_revision);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  
+  if(!dat.depthbufferOutput)
+  {
+    dat.depthbufferOutput = seeder.getDepthBuf(dat.history_key);
+    dat.direction = 0;
+  }
+}
+
+void MandelRenderer::end_seed(RenderData &dat)
+{
+  if(!dat.temporal_seed || dat.history_key >= FACE_HISTORY_KEYS)
+    return;
+  seeder.end(dat.history_key, dat.depthbufferOutput);
+}
+
+void MandelRenderer::render_interleaved(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+{
+  GLint target;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+  
+  RenderData seeded = dat;
+  begin_seed(pos, forward, up, size, seeded);
+  
+  RenderData sparse = seeded;
+  sparse.gbuffer_normal = sparse.gbuffer_material = 0;
+  sparse.interleave_phase = interleaver.begin(dat.history_key, size, dat.interleave);
+  sparse.depthbufferOutput = interleaver.getDepthBuf();
+  sparse.direction = 0;
+  
+  // skipped and discarded pixels keep the clear color, as in a full march
+  glViewport(0, 0, size.x, size.y);
   glClearColor(0.f, 1.f, 0.f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT);
+  march(prog, pos, forward, up, size, size, glm::vec2(0), sparse);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  interleaver.resolve(dat.history_key, size, pos, forward, up, dat.zoom_level, dat.fle, seeded.depthbufferOutput, seeded.direction);
+  end_seed(seeded);
+}
+
+void MandelRenderer::render_upsampled(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat)
+{
+  GLint target;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+  
+  // the real march, depths always go out as they steer the filter
+  glm::vec2 lowSize = glm::max(glm::floor(size*dat.resolution_scale), glm::vec2(1));
+  upsampler.beginLow(lowSize);
+  RenderData low = dat;
+  low.resolution_scale = 1.f;
+  low.depthbufferOutput = upsampler.getLowDepthBuf();
+  low.direction = 0;
+  // the g-buffer would be at the wrong resolution
+  low.deferred = 0;
+  low.gbuffer_normal = low.gbuffer_material = 0;
+  render_internal(prog, pos, forward, up, lowSize, low);
+  
+  // the guide only has to find the silhouettes, so it gets a cut budget
+  // and skips the shading entirely
+  upsampler.beginGuide(size);
+  glViewport(0, 0, size.x, size.y);
+  RenderData guide = dat;
+  guide.depth_only = 1;
+  guide.exhaust = 1;
+  guide.foveated = 0;
+  guide.collect_stats = 0;
+  guide.depthbufferOutput = 0;
+  guide.interleave = 1;
+  guide.gbuffer_normal = guide.gbuffer_material = 0;
+  guide.intersect_step_count = glm::max(dat.intersect_step_count/2, 1);
+  march(prog, pos, forward, up, size, size, glm::vec2(0), guide);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  upsampler.resolve(size, dat.depthbufferOutput, dat.direction);
+}
+
+void MandelRenderer::march(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, glm::vec2 bufferSize, glm::vec2 gazePoint, RenderData &dat)
+{
+  // the shader only takes the orientation from it, the origin goes in
+  // separately so it can keep its precision
+  glm::mat4 view = glm::lookAt(glm::vec3(0), forward, up);
+  
+  // once a pixel at unit distance gets too narrow for floats to place,
+  // switch over to emulated doubles, and once too narrow for those, to
+  // native ones
+  double footprint = 2./(glm::min(size.x, size.y)*dat.fle)/dat.zoom_level;
+  int precision = PRECISION_FLOAT;
+  if(dat.extended_precision && df64Program && footprint < dat.df64_footprint)
+    precision = PRECISION_DF64;
+  if(dat.extended_precision && fp64Program && footprint < (df64Program ? dat.fp64_footprint : dat.df64_footprint))
+    precision = PRECISION_FP64;
+  if(precision == PRECISION_DF64)
+    prog = df64Program;
+  else if(precision == PRECISION_FP64)
+    prog = fp64Program;
+  if(dat.layered)
+    prog = dat.packed_depth ? packedPrograms[precision] : layeredPrograms[precision];
+  lastPrecision = precision;
+  bool precise = precision == PRECISION_FP64;
   
   prog->bind();
 
-  glBindImageTexture(0, dat.depthbufferInput, 0, GL_TRUE, dat.direction, GL_READ_ONLY, GL_R32F);
+  // only the face being drawn is bound, as the shader sees a plain image2D,
+  // unless it marches all of them
+  GLboolean layered = dat.layered ? GL_TRUE : GL_FALSE;
+  GLenum depthFormat = dat.packed_depth ? GL_R16_SNORM : GL_R32F;
+  glBindImageTexture(0, dat.depthbufferInput, 0, layered, dat.direction, GL_READ_ONLY, depthFormat);
   glUniform1i(prog->getUniform("inputDepthBuffer"), 0);
 
-  glBindImageTexture(1, dat.depthbufferOutput, 0, GL_TRUE, dat.direction, GL_WRITE_ONLY, GL_R32F);
+  glBindImageTexture(1, dat.depthbufferOutput, 0, layered, dat.direction, GL_WRITE_ONLY, depthFormat);
   glUniform1i(prog->getUniform("outputDepthBuffer"), 1);
+  glUniform1i(prog->getUniform("writeDepth"), dat.depthbufferOutput != 0);
+  
+  glBindImageTexture(2, dat.seed_buffer, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32UI);
+  glUniform1i(prog->getUniform("seedBuffer"), 2);
+  glUniform1i(prog->getUniform("seeded"), dat.seed_buffer != 0);
+  glUniform1f(prog->getUniform("seedFraction"), dat.seed_fraction);
+  
+  glBindImageTexture(3, dat.gbuffer_normal, 0, layered, dat.direction, GL_READ_WRITE, GL_RGBA16F);
+  glUniform1i(prog->getUniform("gbufferNormal"), 3);
+  glBindImageTexture(4, dat.gbuffer_material, 0, layered, dat.direction, GL_READ_WRITE, GL_RGBA16F);
+  glUniform1i(prog->getUniform("gbufferMaterial"), 4);
+  glBindImageTexture(5, dat.gbuffer_depth, 0, layered, dat.direction, GL_READ_ONLY, depthFormat);
+  glUniform1i(prog->getUniform("gbufferDepth"), 5);
+  if(dat.packed_depth)
+    glUniform2f(prog->getUniform("depthLogRange"), LayerPool::PACKED_DEPTH_LOG_MIN, LayerPool::PACKED_DEPTH_LOG_MAX);
+  glUniform1i(prog->getUniform("writeGBuffer"), dat.gbuffer_normal != 0 && !dat.shade_only);
+  glUniform1i(prog->getUniform("shadeOnly"), !!dat.shade_only);
+  // the g-buffer was written through image stores
+  if(dat.shade_only)
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glUniform1i(prog->getUniform("collectStats"), !!dat.collect_stats);
+  glUniform1i(prog->getUniform("nextPass"), dat.next_pass);
+  glUniform1i(prog->getUniform("continueRays"), !!dat.continue_rays);
+  glUniform1f(prog->getUniform("bandFar"), dat.band_far);
+  glUniform1i(prog->getUniform("octahedral"), !!dat.octahedral);
   
   glUniform2f(prog->getUniform("resolution"), static_cast<float>(size.x), static_cast<float>(size.y));
   glUniform1f(prog->getUniform("intersectThreshold"), dat.intersect_threshold);
   glUniform1i(prog->getUniform("intersectStepCount"), dat.intersect_step_count);
   glUniform1f(prog->getUniform("intersectStepFactor"), dat.intersect_step_factor);
-  glUniform3fv(prog->getUniform("clearColor"), 1, (float*)&dat.clear_color);
-  glUniform3fv(prog->getUniform("yColor"), 1, (float*)&dat.y_color);
-  glUniform3fv(prog->getUniform("zColor"), 1, (float*)&dat.z_color);
-  glUniform3fv(prog->getUniform("wColor"), 1, (float*)&dat.w_color);
-  glUniform3fv(prog->getUniform("diffc1"), 1, (float*)&dat.diff1);
-  glUniform3fv(prog->getUniform("diffc2"), 1, (float*)&dat.diff2);
-  glUniform3fv(prog->getUniform("diffc3"), 1, (float*)&dat.diff3);
-  glUniform1f(prog->getUniform("zoomLevel"), dat.zoom_level);
+  // the colors sit still for most frames, uniforms keep their values
+  uint64_t shading = dat.hash().shading;
+  if(shadingProg != prog.get() || shadingUploaded != shading)
+  {
+    glUniform3fv(prog->getUniform("clearColor"), 1, (float*)&dat.clear_color);
+    glUniform3fv(prog->getUniform("yColor"), 1, (float*)&dat.y_color);
+    glUniform3fv(prog->getUniform("zColor"), 1, (float*)&dat.z_color);
+    glUniform3fv(prog->getUniform("wColor"), 1, (float*)&dat.w_color);
+    glUniform3fv(prog->getUniform("diffc1"), 1, (float*)&dat.diff1);
+    glUniform3fv(prog->getUniform("diffc2"), 1, (float*)&dat.diff2);
+    glUniform3fv(prog->getUniform("diffc3"), 1, (float*)&dat.diff3);
+    glUniform1i(prog->getUniform("doFog"), !!dat.doFog);
+    shadingProg = prog.get();
+    shadingUploaded = shading;
+  }
+  if(precise)
+    glUniform1d(prog->getUniform("zoomLevel"), dat.zoom_level);
+  else
+    glUniform1f(prog->getUniform("zoomLevel"), static_cast<float>(dat.zoom_level));
   glUniform1f(prog->getUniform("startOffset"), dat.map_start_offset);
   glUniform1f(prog->getUniform("fle"), dat.fle);
   glUniform1i(prog->getUniform("modulo"), dat.modulo);
@@ -94,15 +619,48 @@ void MandelRenderer::render_internal(std::shared_ptr<Program> prog, glm::vec3 po
   glUniform1f(prog->getUniform("juliaFactor"), dat.juliaFactor);
   glUniform3fv(prog->getUniform("juliaPoint"), 1, (float*)&dat.juliaPoint);
   glUniform1i(prog->getUniform("mapIterCount"), dat.map_iter_count);
-  glUniform3fv(prog->getUniform("camOrigin"), 1, glm::value_ptr(pos));
+  // everything else goes in relative to the camera, which is only ever
+  // placed in doubles
+  if(precise)
+    glUniform3dv(prog->getUniform("camOrigin"), 1, glm::value_ptr(pos));
+  glUniform3fv(prog->getUniform("boundsCenter"), 1, glm::value_ptr(glm::vec3(-pos)));
+  // the fractal space origin split into two floats, the second only
+  // matters to the emulated doubles
+  glm::dvec3 origin = pos/dat.zoom_level;
+  glm::vec3 originHi = glm::vec3(origin);
+  glUniform3fv(prog->getUniform("originHi"), 1, glm::value_ptr(originHi));
+  glUniform3fv(prog->getUniform("originLo"), 1, glm::value_ptr(glm::vec3(origin - glm::dvec3(originHi))));
   glUniform1i(prog->getUniform("exhaust"), !!dat.exhaust);
   glUniform1i(prog->getUniform("movingJulia"), !!dat.movingJulia);
-  glUniform1i(prog->getUniform("doFog"), !!dat.doFog);
+  
+  glUniform1i(prog->getUniform("foveated"), !!dat.foveated);
+  glUniform2f(prog->getUniform("bufferResolution"), bufferSize.x, bufferSize.y);
+  glUniform2f(prog->getUniform("gazePoint"), gazePoint.x, gazePoint.y);
+  glUniform3fv(prog->getUniform("gazeDir"), 1, glm::value_ptr(dat.gaze_dir));
+  glUniform1f(prog->getUniform("foveaDensity"), dat.fovea_density);
+  glUniform1f(prog->getUniform("foveaStepFalloff"), dat.fovea_step_falloff);
+  glUniform1f(prog->getUniform("foveaIterFalloff"), dat.fovea_iter_falloff);
+  
+  glUniform1i(prog->getUniform("depthOnly"), !!dat.depth_only);
+  glUniform1i(prog->getUniform("guideIterDrop"), dat.guide_iter_drop);
+  glUniform1i(prog->getUniform("interleave"), dat.interleave);
+  glUniform1i(prog->getUniform("interleavePhase"), dat.interleave_phase);
+  
+  glUniform2f(prog->getUniform("jitter"), dat.jitter.x, dat.jitter.y);
+  glUniform1i(prog->getUniform("iterBoost"), dat.iter_boost);
+  glUniform1i(prog->getUniform("shadowSteps"), dat.shadow_steps);
+  glUniform1f(prog->getUniform("shadowSharpness"), dat.shadow_sharpness);
+  glUniform1f(prog->getUniform("footprintBias"), dat.footprint_bias);
   
   glUniformMatrix4fv(prog->getUniform("view"), 1, GL_TRUE, glm::value_ptr(view));
   
   glBindVertexArray(VertexArrayUnitPlane);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
+  // passes of onion layers go without an instance once the ones before
+  // them left nothing unresolved
+  if(dat.pass_command >= 0)
+    glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(dat.pass_command*4*sizeof(GLuint)));
+  else
+    glDrawArrays(GL_TRIANGLES, 0, 6);
 
   prog->unbind();
 }
@@ -3,8 +3,14 @@
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <cstdint>
 #include <glad/glad.h>
 #include "Program.h"
+#include "Foveation.h"
+#include "Upsampler.h"
+#include "Interleaver.h"
+#include "DepthSeeder.h"
+#include "GBuffer.h"
 #include "imgui.h"
 
 // mutual dependencies
@@ -28,7 +34,7 @@ struct MandelRenderer
     GLint intersect_step_count = 128;
     GLfloat intersect_step_factor = 1.;
     
-    GLfloat zoom_level = 1.0;
+    GLdouble zoom_level = 1.0;
     GLfloat map_start_offset = 1.0;
     
     GLfloat fle = 1.;
@@ -56,24 +62,232 @@ struct MandelRenderer
 	GLboolean doFog = 0;
 
 	GLfloat time = 0.;
+
+	// when set, pixel density and march budgets fall off away from the gaze
+	GLboolean foveated = 0;
+	// the gaze point, in [0, 1] across the view
+	ImVec2 gaze = ImVec2(.5f, .5f);
+	// fraction of the pixels kept along each axis, the fovea itself stays
+	// at full density
+	GLfloat fovea_density = .5f;
+	// fraction of the step budget lost per radian away from the gaze
+	GLfloat fovea_step_falloff = .5f;
+	// map iterations dropped per radian away from the gaze
+	GLfloat fovea_iter_falloff = 4.f;
+	
+	// when marching below full resolution, filter back up along the edges of
+	// a cheap full resolution depth march, instead of bilinearly
+	GLboolean edge_upsample = 1;
+	// map iterations the depth march for the edges goes without
+	GLint guide_iter_drop = 2;
+	
+	// 1 in this many pixels gets marched a frame, 1, 2 or 4, the rest being
+	// reprojected from the frames before
+	GLint interleave = 1;
+	
+	// the soft shadow march, its step count and how hard its edges are
+	GLint shadow_steps = 64;
+	GLfloat shadow_sharpness = 32.f;
+	
+	// map iterations each sample gets past the ones that resolve the width
+	// of its pixel there, so distant samples get fewer and near ones more.
+	// `map_iter_count` stays the least any of them gets
+	GLfloat footprint_bias = 1.f;
+	
+	// when set, marches whose pixels at unit distance are narrower than
+	// `df64_footprint` in fractal space go through the emulated double
+	// program, and below `fp64_footprint` through the native one
+	GLboolean extended_precision = 1;
+	GLfloat df64_footprint = 1e-5f;
+	GLfloat fp64_footprint = 1e-11f;
+	
+	// when set, rays of the direct views start near the reprojected hits of
+	// the frame before, at this fraction of the distance
+	GLboolean temporal_seed = 1;
+	GLfloat seed_fraction = .9f;
+	
+	// when set, plain marches also store their surface terms, so changing
+	// only the colors reshades them instead of marching again
+	GLboolean deferred = 1;
     
     GLint depthbufferInput = 0;
     GLint depthbufferOutput = 0;
     int direction = 0;
+    glm::vec3 gaze_dir = glm::vec3(0, 0, -1);
+    // fraction of `size` along each axis actually marched
+    float resolution_scale = 1.f;
+    GLboolean depth_only = 0;
+    GLboolean collect_stats = 0;
+    int interleave_phase = 0;
+    // which history an interleaved march builds on
+    int history_key = 0;
+    // subpixel offset of the rays, and map iterations on top of the usual
+    glm::vec2 jitter = glm::vec2(0);
+    int iter_boost = 0;
+    GLuint seed_buffer = 0;
+    GLuint gbuffer_normal = 0, gbuffer_material = 0, gbuffer_depth = 0;
+    GLboolean shade_only = 0;
+    // the faces' images are bound whole, and the march goes through
+    // `layeredPrograms`
+    GLboolean layered = 0;
+    // the command of the bound pass buffer the march is drawn through, and
+    // the one its unresolved pixels let through, -1 for neither
+    int pass_command = -1;
+    int next_pass = -1;
+    // rays start from where `depthbufferInput` handed them over, and are
+    // handed over themselves past `band_far` world units, 0 for never
+    GLboolean continue_rays = 0;
+    GLfloat band_far = 0.f;
+    // the depth images are log packed 16 bit ones, and the layered march
+    // goes through `packedPrograms`
+    GLboolean packed_depth = 0;
+    // the pixels map out every direction in an equal area octahedron,
+    // instead of looking through a pinhole
+    GLboolean octahedral = 0;
+    
+    // one hash per class of setting, over the fields of that class only.
+    // The per march fields above, from the depth buffers on, are set anew
+    // for every march and belong to none
+    struct Hashes {
+      uint64_t geometry = 0, shading = 0, display = 0, time = 0;
+    };
+    Hashes hash() const;
+    // whether the time changes the fractal, which a moving julia point only
+    // does once it has some weight
+    bool juliaMoves() const;
   } data;
   
+  // what a change to a setting invalidates. Geometry needs marching again,
+  // shading only needs the g-buffers shaded again, display settings only
+  // change how later frames get drawn, and the time only shows while the
+  // julia point moves, where it counts as geometry
+  enum Dirty {
+    DIRTY_GEOMETRY = 1,
+    DIRTY_SHADING = 2,
+    DIRTY_DISPLAY = 4,
+    DIRTY_TIME = 8
+  };
+  // the classes that differ between `a` and `b`
+  static int diff(const RenderData::Hashes &a, const RenderData::Hashes &b);
+  
+  Foveation foveation;
+  Upsampler upsampler;
+  Interleaver interleaver;
+  DepthSeeder seeder;
+  GBuffer gbuffer;
+  
+  // interleaving histories from here on belong to the cube faces
+  static const int FACE_HISTORY_KEYS = 16;
+  
+  // the march shader built with DF64_PRECISION and DOUBLE_PRECISION, for
+  // deep zooms. Without either, the other one takes over from floats, and
+  // without both everything is marched in floats
+  std::shared_ptr<Program> df64Program;
+  std::shared_ptr<Program> fp64Program;
+  
+  // the rungs of the precision ladder, in the order they take over
+  enum Precision {
+    PRECISION_FLOAT,
+    PRECISION_DF64,
+    PRECISION_FP64
+  };
+  
+  // the march programs again, by precision, built with LAYERED_FACES so one
+  // draw covers all six faces of a layer. Faces get marched one at a time
+  // unless there is one for every precision in use
+  std::shared_ptr<Program> layeredPrograms[PRECISION_FP64 + 1];
+  // the same built with PACKED_DEPTH as well, for faces whose depths are
+  // log packed into 16 bits. Those need one for every precision in use
+  std::shared_ptr<Program> packedPrograms[PRECISION_FP64 + 1];
+  
   static GLuint VertexArrayUnitPlane;
   static GLuint VertexBufferUnitPlane;
   
   // prepares internal rendering structures
   static void init();
   
-  void render(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, float zoomLevel, glm::vec2 size, bool exhaust);
+  // with a `scale` below 1 the march itself runs at that fraction of `size`,
+  // and gets upsampled to `size` along the edges. Views drawn every frame
+  // need a `historyKey` of their own, below `FACE_HISTORY_KEYS`
+  void render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, bool exhaust, float scale = 1.f, int historyKey = 0);
+  
+  // renders with `dat` in place of `data`, its zoom level included
+  void render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData dat);
+  
+  // `gazeDir` is the world space direction foveation centers on
+  void render(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot, glm::vec3 gazeDir, float scale = 1.f);
+  
+  // marches all faces of `marcher` at once into the bound layered
+  // framebuffer, for faces that would each get a plain march
+  void renderFaces(std::shared_ptr<Program> prog, glm::dvec3 pos, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, bool isRoot);
+  bool canRenderFaces();
+  bool canPackDepth();
+  
+  // marches the same band as `marcher` straight into the bound framebuffer,
+  // on top of what is already there, for layers too near to be shared
+  void renderLayerOverlay(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, bool isRoot);
+  
+  // marches the `tileSize` square at `origin` of a `size` march of cube face
+  // `direction` into the square at `slot` of the bound framebuffer, every
+  // ray exhausted. For faces marched a tile at a time, see TileCache
+  void renderTile(std::shared_ptr<Program> prog, glm::dvec3 pos, int direction, double zoomLevel, int mapIterCount, glm::vec2 size, glm::vec2 origin, glm::vec2 slot, int tileSize);
+  
+  // shades face `direction` of `marcher` again from its g-buffer, with the
+  // camera it was marched from
+  void reshade(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, double zoomLevel, glm::vec2 size, MarchingLayer &marcher, int direction);
+  // the same for all faces at once, into the bound layered framebuffer
+  void reshadeFaces(std::shared_ptr<Program> prog, glm::dvec3 pos, double zoomLevel, glm::vec2 size, MarchingLayer &marcher);
   
-  void render(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, float zoomLevel, glm::vec2 size, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot);
+  // diffs `data` against the last frame, once per frame, bumping the
+  // revisions of the classes it dirtied. Returns those classes, with a
+  // moving julia point's time folded into geometry
+  int updateRevisions();
+  // what the last call to updateRevisions found dirtied
+  int dirty();
+  int geometryRevision();
+  int shadingRevision();
+  int displayRevision();
+  
+  // which program the last march went through
+  int marchPrecision();
+  
+  // world space direction of the ray through the gaze point of a view
+  glm::vec3 gazeDirection(glm::vec3 forward, glm::vec3 up, glm::vec2 size);
   
 private:
-  void render_internal(std::shared_ptr<Program> prog, glm::vec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  RenderData::Hashes lastHashes;
+  bool haveLastHashes = false;
+  int dirty_mask = 0;
+  int lastPrecision = PRECISION_FLOAT;
+  int geometry_revision = 0, shading_revision = 0, display_revision = 0;
+  
+  // what the shading uniforms of `shadingProg` were last set to, they
+  // only get set again once that changes
+  Program *shadingProg = nullptr;
+  uint64_t shadingUploaded = 0;
+  
+  // the march of face `direction` of `marcher`, and its shading pass
+  RenderData faceData(double zoomLevel, MarchingLayer &marcher, GLuint inputDepthBuf, int direction, bool isRoot, glm::vec3 gazeDir, float scale);
+  RenderData faceShadeData(double zoomLevel, MarchingLayer &marcher, int direction);
+  
+  // points a direct view's plain march at its g-buffer, true when that
+  // already holds this very march and only needs shading
+  bool prepare_gbuffer(glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  // pixel a gaze direction lands on in a view, pinned to the nearest edge
+  // when it falls outside of it
+  glm::vec2 projectGaze(glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  
+  void render_internal(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat, bool clear = true);
+  // seeds the march `dat` describes from the last frame of its view, for
+  // direct views, making sure it writes out its depths for the next one
+  void begin_seed(glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  void end_seed(RenderData &dat);
+  // marches 1 in `dat.interleave` pixels, and reprojects the others
+  void render_interleaved(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  // marches at `dat.resolution_scale`, then upsamples into the bound framebuffer
+  void render_upsampled(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, RenderData &dat);
+  // issues the march itself into a `bufferSize` framebuffer
+  void march(std::shared_ptr<Program> prog, glm::dvec3 pos, glm::vec3 forward, glm::vec3 up, glm::vec2 size, glm::vec2 bufferSize, glm::vec2 gazePoint, RenderData &dat);
 };
 
 #endif
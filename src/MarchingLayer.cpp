@@ -1,16 +1,21 @@
 #include "MarchingLayer.h"
 
+#include <cstring>
+#include <limits>
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 
-Shape MarchingLayer::skybox_mesh;
-
-MarchingLayer::MarchingLayer(int mapLevel, GLuint stencil, int w, int h)
+MarchingLayer::MarchingLayer(int mapLevel, LayerPool &facePool, const LayerPool::Layout &faceLayout)
 {
   mappinglevel = mapLevel;
-  stencilID = stencil;
-  width = w;
-  height = h;
+  pool = &facePool;
+  layout = faceLayout;
+  captureScale = 0.f;
+  faceScale = glm::vec2(1.f);
+  nearestDepth = std::numeric_limits<float>::infinity();
+  unresolvedCount = 0;
+  stepCount = 0.;
+  geometryRevision = shadingRevision = -1;
+  shadeable = false;
   
   initTextures();
 }
@@ -39,84 +44,299 @@ MarchingLayer::~MarchingLayer()
 
 void MarchingLayer::initTextures()
 {
-  glGenTextures(1, &texArray);
-  glGenTextures(1, &marchDepthBufArray);
-  glGenFramebuffers(NUM_SIDES, framebufs.data());
-  
-  glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
-      
-  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, width, height, NUM_SIDES);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  
-  glBindTexture(GL_TEXTURE_2D_ARRAY, marchDepthBufArray);
+  faces = pool->acquire(layout);
+  glGenBuffers(2, statsBufs);
   
-  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32F, width, height, NUM_SIDES);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  
-  for(int i = 0; i < NUM_SIDES; i++)
+  // as a redraw leaves them before marching
+  GLuint stats[3] = { 0xFFFFFFFFu, 0, 0 };
+  for(int i = 0; i < 2; i++)
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, framebufs[i]);
-    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texArray, 0, i);
-    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, stencilID, 0, i);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBufs[i]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(stats), stats, GL_DYNAMIC_READ);
+    statsFences[i] = 0;
+    statsScales[i] = 0.;
   }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  statsLatest = 0;
+}
+
+void MarchingLayer::releaseFaces()
+{
+  pool->release(faces);
+}
+
+bool MarchingLayer::hasFaces()
+{
+  return faces.color != 0;
+}
+
+bool MarchingLayer::packsDepth()
+{
+  return layout.depth == GL_R16_SNORM;
+}
+
+bool MarchingLayer::isOctahedral()
+{
+  return layout.sides == 1;
+}
+
+void MarchingLayer::resize(const LayerPool::Layout &faceLayout)
+{
+  if(faceLayout == layout && faces.color)
+    return;
+  
+  pool->release(faces);
+  layout = faceLayout;
+  faces = pool->acquire(layout);
+  // nothing left to reproject or shade again
+  captureScale = 0.f;
+  shadeable = false;
+  geometryRevision = shadingRevision = -1;
 }
 
 void MarchingLayer::release()
 {
-  glDeleteTextures(1, &texArray);
-  glDeleteTextures(1, &marchDepthBufArray);
-  glDeleteFramebuffers(NUM_SIDES, framebufs.data());
+  if(pool)
+    pool->release(faces);
+  for(int i = 0; i < 2; i++)
+  {
+    if(statsFences[i])
+      glDeleteSync(statsFences[i]);
+    statsFences[i] = 0;
+  }
+  glDeleteBuffers(2, statsBufs);
 }
 
 void MarchingLayer::claimGLObjects(MarchingLayer &other)
 {
-    stencilID = other.stencilID;
-    texArray = other.texArray;
-    marchDepthBufArray = other.marchDepthBufArray;
-    framebufs = other.framebufs;
+    pool = other.pool;
+    faces = other.faces;
+    for(int i = 0; i < 2; i++)
+    {
+      statsBufs[i] = other.statsBufs[i];
+      statsFences[i] = other.statsFences[i];
+      statsScales[i] = other.statsScales[i];
+      other.statsBufs[i] = 0;
+      other.statsFences[i] = 0;
+    }
+    statsLatest = other.statsLatest;
+    nearestDepth = other.nearestDepth;
+    unresolvedCount = other.unresolvedCount;
+    stepCount = other.stepCount;
     
-    other.stencilID = 0;
-    other.texArray = 0;
-    other.marchDepthBufArray = 0;
-    other.framebufs.fill(0);
+    other.faces = LayerPool::Faces();
 }
 
 GLint MarchingLayer::getMarchDepthBuf()
 {
-  return marchDepthBufArray;
+  return faces.depth;
 }
 
-// display the cached texture
-void MarchingLayer::draw(camera &cam, std::shared_ptr<Program> &ccSphereshader)
+GLuint MarchingLayer::getGBufNormal()
 {
-  ccSphereshader->bind();
-  
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
-  glUniform1i(ccSphereshader->getUniform("sphereMap"), 0);
+  return faces.normal;
+}
+
+GLuint MarchingLayer::getGBufMaterial()
+{
+  return faces.material;
+}
+
+void MarchingLayer::readStats()
+{
+  // the newest finished march wins, anything older is then stale anyway,
+  // and while neither has finished the last values stay
+  for(int k = 0; k < 2; k++)
+  {
+    int i = k == 0 ? statsLatest : 1 - statsLatest;
+    if(!statsFences[i])
+      continue;
+    GLenum state = glClientWaitSync(statsFences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+      continue;
+    
+    GLuint stats[3];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBufs[i]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    
+    // untouched when nothing was hit at all
+    float depth = std::numeric_limits<float>::infinity();
+    if(stats[0] != 0xFFFFFFFFu)
+      memcpy(&depth, &stats[0], sizeof(depth));
+    nearestDepth = depth/statsScales[i];
+    unresolvedCount = static_cast<int>(stats[1]);
+    stepCount = stats[2];
+    
+    for(int j = k; j < 2; j++)
+    {
+      int done = j == 0 ? statsLatest : 1 - statsLatest;
+      if(statsFences[done])
+        glDeleteSync(statsFences[done]);
+      statsFences[done] = 0;
+    }
+    return;
+  }
+}
+
+float MarchingLayer::getNearestDepth()
+{
+  readStats();
+  return nearestDepth;
+}
+
+int MarchingLayer::getUnresolvedCount()
+{
+  readStats();
+  return unresolvedCount;
+}
+
+double MarchingLayer::getStepCount()
+{
+  readStats();
+  return stepCount;
+}
+
+const MarchingLayer::Pass &MarchingLayer::getPass()
+{
+  return pass;
+}
+
+bool MarchingLayer::isStale(camera &cam, float radius)
+{
+  if(captureScale <= 0.f)
+    return true;
   
-  glm::vec3 camdir = cam.getForward();
+  // zooming changes the detail that was marched, not just the view
+  double zoomRatio = cam.zoomLevel/captureScale;
+  if(zoomRatio > 1.01f || zoomRatio < 1.f/1.01f)
+    return true;
   
-  glm::mat4 camAtOrigin = glm::inverse(glm::lookAt(glm::vec3(0, 0, 0), camdir, cam.getUp())) * glm::translate(glm::mat4(1), glm::vec3(0, 0, 1.));
-  glUniformMatrix4fv(ccSphereshader->getUniform("MVP"), 1, GL_TRUE, glm::value_ptr(camAtOrigin));
-  MarchingLayer::skybox_mesh.draw(ccSphereshader);
-  ccSphereshader->unbind();
+  return glm::length(cam.position()/cam.zoomLevel - capturePos/captureScale) > radius;
+}
+
+bool MarchingLayer::isCurrent(camera &cam, int geometryRev)
+{
+  // faces see all around, so only the position matters
+  return shadeable && geometryRevision == geometryRev
+    && capturePos == cam.position() && captureScale == cam.zoomLevel;
+}
+
+bool MarchingLayer::hasGeometry(int geometryRev)
+{
+  return geometryRevision == geometryRev;
+}
+
+bool MarchingLayer::isShaded(int shadingRev)
+{
+  return shadingRevision == shadingRev;
+}
+
+bool MarchingLayer::canReshade()
+{
+  return shadeable;
+}
+
+void MarchingLayer::reshade(std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel)
+{
+  glm::vec2 size = glm::vec2(layout.width, layout.height)*faceScale;
+  if(mandel.canRenderFaces() && !isOctahedral())
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, faces.layeredFramebuf);
+    mandel.reshadeFaces(mandelShader, capturePos, captureScale, size, *this);
+  }
+  else
+  {
+    for(int i = 0; i < layout.sides; i++)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, faces.framebufs[i]);
+      mandel.reshade(mandelShader, capturePos, dirEnumToDirection(i), dirEnumToUp(i), captureScale, size, *this, i);
+    }
+  }
+  shadingRevision = mandel.shadingRevision();
+}
+
+MarchingLayer::CompositeInput MarchingLayer::compositeInput(camera &cam, bool reproject, glm::vec3 eyeOffset)
+{
+  CompositeInput in;
+  in.color = faces.color;
+  in.depth = faces.depth;
+  // everything is compared in fractal space, so zooming is reprojected as
+  // well. Only the offset between them matters, taken in doubles so deep
+  // zooms don't cancel it out
+  in.eyeShift = glm::vec3((cam.position() + glm::dvec3(eyeOffset))/cam.zoomLevel - capturePos/captureScale);
+  in.captureScale = static_cast<float>(captureScale);
+  in.faceScale = faceScale;
+  in.reproject = reproject && captureScale > 0.f;
+  in.pass = pass.index;
+  in.packedDepth = packsDepth();
+  in.octahedral = isOctahedral();
+  return in;
+}
+
+bool MarchingLayer::marchesPlain(MandelRenderer &mandel, float scale)
+{
+  bool upsampled = mandel.data.edge_upsample && scale < 1.f;
+  return !upsampled && !mandel.data.foveated && mandel.data.interleave <= 1;
 }
 
 // update the cached texture
-void MarchingLayer::redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, GLuint inputDepthBuf, bool isRoot)
+void MarchingLayer::redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, GLuint inputDepthBuf, bool isRoot, float scale, const Pass &pass)
 {
-  for(int i = 0; i < NUM_SIDES; i++)
+  glm::vec2 fullSize(layout.width, layout.height);
+  // upsampled faces fill the whole texture, otherwise only a corner is used
+  bool octahedral = isOctahedral();
+  bool upsampled = !octahedral && mandel.data.edge_upsample && scale < 1.f;
+  // the g-buffer is only written by plain marches, pixel for pixel
+  bool plain = octahedral || marchesPlain(mandel, scale);
+  this->pass = pass;
+  shadeable = mandel.data.deferred && plain;
+  geometryRevision = mandel.geometryRevision();
+  shadingRevision = mandel.shadingRevision();
+  glm::vec2 size = upsampled ? fullSize : glm::max(glm::floor(fullSize*scale), glm::vec2(1));
+  
+  capturePos = cam.position();
+  captureScale = cam.zoomLevel;
+  faceScale = size/fullSize;
+  
+  // march into the other stats buffer than last time, a still pending read
+  // of this one is superseded by the other
+  statsLatest = 1 - statsLatest;
+  if(statsFences[statsLatest])
+    glDeleteSync(statsFences[statsLatest]);
+  statsScales[statsLatest] = captureScale;
+  GLuint stats[3] = { 0xFFFFFFFFu, 0, 0 };
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBufs[statsLatest]);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, statsBufs[statsLatest]);
+  
+  if(octahedral)
+  {
+    // one draw covers the whole map
+    glBindFramebuffer(GL_FRAMEBUFFER, faces.framebufs[0]);
+    mandel.render(mandelShader, cam.position(), dirEnumToDirection(0), dirEnumToUp(0), cam.zoomLevel, size, *this, inputDepthBuf, 0, isRoot, glm::vec3(0, 0, -1));
+  }
+  else if(plain && mandel.canRenderFaces())
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, framebufs[i]);
-    mandel.render(mandelShader, cam.pos, dirEnumToDirection(i), dirEnumToUp(i), cam.zoomLevel, glm::vec2(width, height), *this, inputDepthBuf, i, isRoot);
+    // plain marches are the same for every face but for its basis
+    glBindFramebuffer(GL_FRAMEBUFFER, faces.layeredFramebuf);
+    mandel.renderFaces(mandelShader, cam.position(), cam.zoomLevel, size, *this, inputDepthBuf, isRoot);
   }
+  else
+  {
+    // the window size isn't known here, so the gaze is taken over a square view
+    glm::vec3 gazeDir = mandel.gazeDirection(cam.getForward(), glm::vec3(0, 1, 0), glm::vec2(1, 1));
+    
+    for(int i = 0; i < NUM_SIDES; i++)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, faces.framebufs[i]);
+      mandel.render(mandelShader, cam.position(), dirEnumToDirection(i), dirEnumToUp(i), cam.zoomLevel, size, *this, inputDepthBuf, i, isRoot, gazeDir, upsampled ? scale : 1.f);
+    }
+  }
+  
+  // the counters are written from the march, so reading them back takes a
+  // barrier ahead of the fence
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  statsFences[statsLatest] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
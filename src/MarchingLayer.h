@@ -7,33 +7,76 @@
 
 #include "camera.h"
 #include "Program.h"
-#include "Shape.h"
 #include "directions.h"
+#include "LayerPool.h"
 
 // mutual dependencies
 class MarchingLayer;
 #include "MandelRenderer.h"
 
 class MarchingLayer {
+public:
+  // how the last redraw marched the layer, see MarchingManager::redraw
+  struct Pass
+  {
+    // the indirect command of the bound pass buffer the faces were drawn
+    // through, and the one their unresolved pixels let through, -1 when
+    // drawn directly
+    int index = -1, next = -1;
+    // when set, rays pick up where the input depths handed them over, and
+    // get handed over in turn past `bandFar` world units or once they
+    // took `stepBudget` steps
+    bool continues = false;
+    float bandFar = 0.f;
+    int stepBudget = 0;
+  };
+  
+private:
   int stepcount;
-  GLuint stencilID, texArray, marchDepthBufArray;
-  std::array<GLuint, NUM_SIDES> framebufs;
+  // two so one can be marched into while the other gets read back, each
+  // with a fence that signals once its march is done, 0 for none pending
+  GLuint statsBufs[2];
+  GLsync statsFences[2];
+  double statsScales[2];
+  int statsLatest;
+  // the faces and the framebuffers drawing into them, lent out by `pool`
+  LayerPool *pool;
+  LayerPool::Faces faces;
   
   // Variables keeping track of where this snapshot is, for determining
   // if an update is needed
-  glm::vec3 capturePos;
-  float captureScale;
+  glm::dvec3 capturePos;
+  double captureScale;
+  // fraction of each face that was marched, under dynamic resolution
+  glm::vec2 faceScale;
+  
+  // nearest hit of the last finished capture, the pixels it left
+  // unresolved and the march steps it took, read back from `statsBufs` a
+  // frame or so late so nothing waits on the march
+  float nearestDepth;
+  int unresolvedCount;
+  double stepCount;
+  
+  Pass pass;
+  
+  // revisions of the render settings the faces were marched and shaded
+  // with, and whether the march was plain enough for its g-buffer to line
+  // up with the faces
+  int geometryRevision, shadingRevision;
+  bool shadeable;
   
   // internal function used during construction
   void initTextures();
   void release();
+  void readStats();
   
   void claimGLObjects(MarchingLayer &other);
 public:
   int mappinglevel;
-  int width, height;
+  // the size and formats of the faces
+  LayerPool::Layout layout;
 
-  MarchingLayer(int maplevel, GLuint stencil, int w, int h);
+  MarchingLayer(int maplevel, LayerPool &pool, const LayerPool::Layout &layout);
   MarchingLayer(MarchingLayer&& other);
   MarchingLayer &operator=(MarchingLayer &&other);
   ~MarchingLayer();
@@ -42,11 +85,70 @@ public:
   MarchingLayer &operator=(const MarchingLayer &other) = delete;
   
   GLint getMarchDepthBuf();
+  GLuint getGBufNormal();
+  GLuint getGBufMaterial();
+  
+  // distance of the closest surface in the last finished capture, in
+  // fractal space. Like the two below it never waits on a march, and may
+  // lag the newest capture by a frame or so
+  float getNearestDepth();
+  // pixels the last finished capture left to the layers marched after it
+  int getUnresolvedCount();
+  // steps marched over all faces of the last finished capture
+  double getStepCount();
+  const Pass &getPass();
+  
+  // true once the camera has left the region the cached faces can be
+  // reprojected to, `radius` being in fractal space
+  bool isStale(camera &cam, float radius);
+  
+  // what the composite pass takes of a layer, see MarchingManager::draw
+  struct CompositeInput
+  {
+    GLuint color, depth;
+    // the eye less the capture, in fractal space
+    glm::vec3 eyeShift;
+    float captureScale;
+    glm::vec2 faceScale;
+    bool reproject;
+    // the pass that marched it, which may have been skipped
+    int pass;
+    // whether the depths are stored log packed
+    bool packedDepth;
+    bool octahedral;
+  };
+  // `eyeOffset` is in world space, relative to the camera position
+  CompositeInput compositeInput(camera &cam, bool reproject, glm::vec3 eyeOffset);
+  // true when the faces hold exactly what a march from `cam` would give
+  bool isCurrent(camera &cam, int geometryRev);
+  // true when the faces were marched with the current geometry, wherever
+  // they were captured from
+  bool hasGeometry(int geometryRev);
+  // true when the faces are shaded with the current colors
+  bool isShaded(int shadingRev);
+  bool canReshade();
+  // shades the faces again from their g-buffer, without marching
+  void reshade(std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel);
+  
+  // gives the faces a new size or formats, dropping what they held
+  void resize(const LayerPool::Layout &layout);
+  // hands the faces back to the pool ahead of a resize, so layers trading
+  // sizes get each other's
+  void releaseFaces();
+  bool hasFaces();
+  // whether the faces keep their depths log packed, so only march
+  // programs built with PACKED_DEPTH can take them
+  bool packsDepth();
+  // whether the layer is a single equal area octahedral map rather than
+  // cube faces. Those are no pinhole views, so only ever march plainly
+  bool isOctahedral();
   
-  void draw(camera &cam, std::shared_ptr<Program> &ccSphereshader);
-  void redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, GLuint inputDepthBuf, bool isRoot);
+  // whether a redraw at `scale` marches every pixel of every face itself,
+  // with nothing else writing into the faces
+  static bool marchesPlain(MandelRenderer &mandel, float scale);
   
-  static Shape skybox_mesh;
+  // `scale` shrinks the marched part of each face, for dynamic resolution
+  void redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, GLuint inputDepthBuf, bool isRoot, float scale, const Pass &pass);
 };
 
 #endif
@@ -1,15 +1,29 @@
 #include "MarchingManager.h"
 
 #include <algorithm>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
 
 MarchingManager::MarchingManager(int w, int h)
 {
   width = w;
   height = h;
+  passCount = marchedCount = 0;
+  passLatest = 0;
+  bandsMeasured = false;
+  depthFormat = GL_R32F;
   
   createTextures();
+  glGenBuffers(1, &passBuf);
+  glGenBuffers(2, passReadBufs);
+  for(int i = 0; i < 2; i++)
+  {
+    passFences[i] = 0;
+    passReadCounts[i] = 0;
+  }
+  pool.init(stencilArray);
   
-  layers.emplace_back(1, stencilArray, width, height);
+  layers.emplace_back(1, pool, layerLayout(1, 1));
   layer_display_list.push_back(1);
 }
 
@@ -18,6 +32,13 @@ MarchingManager::~MarchingManager()
   glDeleteTextures(1, &stencilArray);
   glDeleteTextures(1, &dummyDepthBuf);
   glDeleteFramebuffers(NUM_SIDES, flushbufs.data());
+  glDeleteBuffers(1, &passBuf);
+  for(int i = 0; i < 2; i++)
+  {
+    if(passFences[i])
+      glDeleteSync(passFences[i]);
+  }
+  glDeleteBuffers(2, passReadBufs);
   // the layers *should* be destructed by the array destructor
 }
   
@@ -61,9 +82,11 @@ void MarchingManager::setDepth(unsigned int depth)
   depth = std::max<unsigned int>(depth, 1);
   if(depth > layers.size()) // Adding more layers
   {
+    // the new layers go in front, and take the sizes the others move off
+    releaseResized(depth);
     while(depth > layers.size())
     {
-      layers.emplace_back(layers.size()+1, stencilArray, width, height);
+      layers.emplace_back(layers.size()+1, pool, layerLayout(layers.size() + 1, depth));
       layer_display_list.push_back(1);
     }
   }
@@ -76,6 +99,87 @@ void MarchingManager::setDepth(unsigned int depth)
     }
   }
   // if equal, we are already there - do nothing
+  resizeLayers();
+}
+
+LayerPool::Layout MarchingManager::layerLayout(int mappinglevel, int count)
+{
+  // the front layer has the highest mapping level, and the nearest band
+  int behind = count - mappinglevel;
+  float scale = std::max(std::pow(layer_scale_falloff, static_cast<float>(behind)), std::min(min_layer_scale, 1.f));
+  LayerPool::Layout layout;
+  layout.width = std::max(static_cast<int>(std::round(width*scale)), 1);
+  layout.height = std::max(static_cast<int>(std::round(height*scale)), 1);
+  if(octahedral)
+  {
+    // as fine as the faces are at their centers, where they are coarsest
+    int side = std::max(static_cast<int>(std::round(std::sqrt(3.14159265f*width*height)*scale)), 1);
+    layout.width = layout.height = side;
+    layout.sides = 1;
+  }
+  if(!color_formats.empty())
+    layout.color = color_formats[std::min<size_t>(behind, color_formats.size() - 1)];
+  layout.depth = depthFormat;
+  return layout;
+}
+
+void MarchingManager::releaseResized(int count)
+{
+  for(auto &layer : layers)
+  {
+    if(layerLayout(layer.mappinglevel, count) != layer.layout)
+      layer.releaseFaces();
+  }
+}
+
+void MarchingManager::resizeLayers()
+{
+  int count = static_cast<int>(layers.size());
+  // everything changing size goes back first, for the others to pick up
+  releaseResized(count);
+  for(auto &layer : layers)
+  {
+    if(layer.hasFaces())
+      continue;
+    layer.resize(layerLayout(layer.mappinglevel, count));
+    // its step counts are gone with it
+    bandsMeasured = false;
+  }
+  
+  // one more layer shifts the others back, so it only needs what the
+  // sizes at the back gain
+  std::vector<LayerPool::Layout> wanted;
+  for(int m = 1; m <= count + 1; m++)
+    wanted.push_back(layerLayout(m, count + 1));
+  for(int m = 1; m <= count; m++)
+  {
+    auto held = std::find(wanted.begin(), wanted.end(), layerLayout(m, count));
+    if(held != wanted.end())
+      wanted.erase(held);
+  }
+  pool.prepare(wanted);
+}
+
+const LayerPool::Layout &MarchingManager::getLayout(int layer)
+{
+  auto a = std::next(layers.begin(), layer);
+  return a->layout;
+}
+
+bool MarchingManager::depthFellBack()
+{
+  return depthFormat != depth_format;
+}
+
+size_t MarchingManager::getMemoryUsage()
+{
+  // the stencil all the framebuffers share counts as well
+  return pool.usedBytes() + static_cast<size_t>(width)*height*NUM_SIDES;
+}
+
+size_t MarchingManager::getIdleMemory()
+{
+  return pool.idleBytes();
 }
 
 int MarchingManager::getDepth()
@@ -89,15 +193,190 @@ GLuint MarchingManager::getDepthBufArray(int layer)
   return a->getMarchDepthBuf();
 }
 
-void MarchingManager::draw(camera &cam, std::shared_ptr<Program> &ccSphereshader)
+int MarchingManager::getUnresolvedCount(int layer)
+{
+  auto a = std::next(layers.begin(), layer);
+  return a->getUnresolvedCount();
+}
+
+double MarchingManager::getStepCount(int layer)
+{
+  auto a = std::next(layers.begin(), layer);
+  return a->getStepCount();
+}
+
+std::vector<float> MarchingManager::getBands()
+{
+  std::vector<float> distances;
+  if(bandsMeasured)
+  {
+    for(float b : bands)
+      distances.push_back(std::exp2(b));
+  }
+  return distances;
+}
+
+int MarchingManager::marchedPasses()
+{
+  // as MarchingLayer::readStats, the newest finished copy wins
+  for(int k = 0; k < 2; k++)
+  {
+    int i = k == 0 ? passLatest : 1 - passLatest;
+    if(!passFences[i])
+      continue;
+    GLenum state = glClientWaitSync(passFences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+      continue;
+    
+    std::vector<GLuint> commands(4*passReadCounts[i]);
+    if(!commands.empty())
+    {
+      glBindBuffer(GL_COPY_READ_BUFFER, passReadBufs[i]);
+      glGetBufferSubData(GL_COPY_READ_BUFFER, 0, commands.size()*sizeof(GLuint), commands.data());
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    marchedCount = 0;
+    for(int p = 0; p < passReadCounts[i]; p++)
+      marchedCount += commands[4*p + 1] != 0;
+    
+    for(int j = k; j < 2; j++)
+    {
+      int done = j == 0 ? passLatest : 1 - passLatest;
+      if(passFences[done])
+        glDeleteSync(passFences[done]);
+      passFences[done] = 0;
+    }
+    break;
+  }
+  return marchedCount;
+}
+
+int MarchingManager::getPassCount()
+{
+  return passCount;
+}
+
+void MarchingManager::composite(camera &cam, std::vector<MarchingLayer*> &run, bool reproject, glm::vec3 eyeOffset, glm::vec2 size, std::shared_ptr<Program> &compositeShader, bool tiled)
+{
+  int count = static_cast<int>(run.size());
+  GLint colorUnits[MAX_COMPOSITE_LAYERS], depthUnits[MAX_COMPOSITE_LAYERS], reprojects[MAX_COMPOSITE_LAYERS], passes[MAX_COMPOSITE_LAYERS], packed[MAX_COMPOSITE_LAYERS], octahedra[MAX_COMPOSITE_LAYERS];
+  glm::vec3 eyeShifts[MAX_COMPOSITE_LAYERS];
+  GLfloat captureScales[MAX_COMPOSITE_LAYERS];
+  glm::vec2 faceScales[MAX_COMPOSITE_LAYERS];
+  for(int i = 0; i < count; i++)
+  {
+    MarchingLayer::CompositeInput in = run[i]->compositeInput(cam, reproject, eyeOffset);
+    colorUnits[i] = 2*i;
+    depthUnits[i] = 2*i + 1;
+    glActiveTexture(GL_TEXTURE0 + colorUnits[i]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, in.color);
+    glActiveTexture(GL_TEXTURE0 + depthUnits[i]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, in.depth);
+    reprojects[i] = in.reproject;
+    eyeShifts[i] = in.eyeShift;
+    captureScales[i] = in.captureScale;
+    faceScales[i] = in.faceScale;
+    passes[i] = in.pass;
+    packed[i] = in.packedDepth;
+    octahedra[i] = in.octahedral;
+  }
+  glActiveTexture(GL_TEXTURE0);
+  
+  compositeShader->bind();
+  glUniform1i(compositeShader->getUniform("layerCount"), count);
+  glUniform1iv(compositeShader->getUniform("colorMaps"), count, colorUnits);
+  glUniform1iv(compositeShader->getUniform("depthMaps"), count, depthUnits);
+  glUniform1iv(compositeShader->getUniform("packedDepth"), count, packed);
+  glUniform1iv(compositeShader->getUniform("octahedral"), count, octahedra);
+  glUniform2f(compositeShader->getUniform("depthLogRange"), LayerPool::PACKED_DEPTH_LOG_MIN, LayerPool::PACKED_DEPTH_LOG_MAX);
+  glUniform1iv(compositeShader->getUniform("reproject"), count, reprojects);
+  glUniform3fv(compositeShader->getUniform("eyeShift"), count, glm::value_ptr(eyeShifts[0]));
+  glUniform1fv(compositeShader->getUniform("captureScale"), count, captureScales);
+  glUniform2fv(compositeShader->getUniform("faceScale"), count, glm::value_ptr(faceScales[0]));
+  // skipped passes left their layers as they were
+  glUniform1iv(compositeShader->getUniform("layerPass"), count, passes);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, passBuf);
+  // on the units past the layers'
+  bool showTiles = tiles.bind(compositeShader, 2*MAX_COMPOSITE_LAYERS) && tiled;
+  glUniform1i(compositeShader->getUniform("tiled"), showTiles);
+  
+  // the basis the faces were marched in, as in glm::lookAt
+  glm::vec3 forward = cam.getForward();
+  glm::vec3 right = glm::normalize(glm::cross(forward, cam.getUp()));
+  glm::vec3 up = glm::cross(right, forward);
+  glUniform2f(compositeShader->getUniform("resolution"), size.x, size.y);
+  glUniform3fv(compositeShader->getUniform("camRight"), 1, glm::value_ptr(right));
+  glUniform3fv(compositeShader->getUniform("camUp"), 1, glm::value_ptr(up));
+  glUniform3fv(compositeShader->getUniform("camForward"), 1, glm::value_ptr(forward));
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  compositeShader->unbind();
+}
+
+void MarchingManager::draw(camera &cam, std::shared_ptr<Program> &compositeShader, glm::vec2 size)
+{
+  // the march depths were written through image stores, and which passes
+  // got drawn through buffer ones
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  
+  // front to back, the deepest layers sitting in front. Runs too long for
+  // one pass are split, the passes going back to front
+  std::vector<MarchingLayer*> shown;
+  int j = 0;
+  for(auto i = layers.begin(); i != layers.end(); i++, j++)
+  {
+    if(layer_display_list[j])
+      shown.insert(shown.begin(), &*i);
+  }
+  while(!shown.empty())
+  {
+    int first = std::max(static_cast<int>(shown.size()) - MAX_COMPOSITE_LAYERS, 0);
+    std::vector<MarchingLayer*> run(shown.begin() + first, shown.end());
+    shown.resize(first);
+    // the run drawn last is the front one
+    composite(cam, run, reproject, glm::vec3(0), size, compositeShader, first == 0);
+  }
+}
+
+void MarchingManager::drawEye(camera &cam, glm::vec3 eyeOffset, glm::vec2 size, std::shared_ptr<Program> &compositeShader, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel)
 {
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  
+  // a pixel spans about this many radians at the center of the view
+  float pixelAngle = 2.f/glm::min(size.x, size.y);
+  float halfBaseline = glm::length(eyeOffset)/cam.zoomLevel;
+  
+  // shared layers between the ones marched per eye get composited together,
+  // front to back within a run, the runs and overlays going back to front
+  std::vector<MarchingLayer*> run;
   int j = 0;
   for(auto i = layers.begin(); i != layers.end(); i++, j++)
   {
     if(!layer_display_list[j])
       continue;
-    i->draw(cam, ccSphereshader);
+    
+    float parallax = halfBaseline/i->getNearestDepth();
+    if(parallax > parallax_limit*pixelAngle)
+    {
+      if(!run.empty())
+        composite(cam, run, true, eyeOffset, size, compositeShader);
+      run.clear();
+      // the first layer is the one that exhausts its rays
+      mandel.renderLayerOverlay(mandelShader, cam.position() + glm::dvec3(eyeOffset), cam.getForward(), glm::vec3(0, 1, 0), cam.zoomLevel, size, *i, i == layers.begin());
+    }
+    else
+    {
+      if(static_cast<int>(run.size()) == MAX_COMPOSITE_LAYERS)
+      {
+        composite(cam, run, true, eyeOffset, size, compositeShader);
+        run.clear();
+      }
+      run.insert(run.begin(), &*i);
+    }
   }
+  if(!run.empty())
+    composite(cam, run, true, eyeOffset, size, compositeShader);
 }
 
 void MarchingManager::redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel)
@@ -114,48 +393,216 @@ void MarchingManager::redraw(camera &cam, std::shared_ptr<Program> &mandelShader
   glStencilFunc(GL_EQUAL, 0x01, 0x01);
   glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
   
+  chooseDepthFormat(cam, mandel);
+  resizeLayers();
   GLuint dBuf = dummyDepthBuf;
+  int count = static_cast<int>(layers.size());
+  
+  // reprojected layers fall back on the ones behind where they are
+  // disoccluded, so those have to see everything themselves
+  bool banded = fit_layers && count > 1 && !reproject && marchesPlain(mandel);
+  if(banded)
+    fitBands(count);
+  else
+    bands.clear();
+  
+  // the deepest layer is marched first and sits in front, so once a pass
+  // leaves nothing unresolved none of the ones after it can show. Each pass
+  // is an indirect draw whose instance only the pass before hands out,
+  // keeping the decision on the GPU
+  bool skipping = skip_resolved && marchesPlain(mandel);
+  passCount = skipping ? static_cast<int>(layers.size()) : 0;
+  if(skipping)
+  {
+    std::vector<GLuint> commands(4*passCount, 0);
+    for(int p = 0; p < passCount; p++)
+      commands[4*p] = 6;
+    commands[1] = 1;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, passBuf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size()*sizeof(GLuint), commands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, passBuf);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, passBuf);
+  }
   
   glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Is this necessary?
   auto i = layers.rbegin();
-  for(unsigned int j = 0; j < layers.size() - 1; i++, j++)
+  for(int j = 0; j < count; i++, j++)
   {
-    i->redraw(cam, mandelShader, mandel, dBuf, false);
+    MarchingLayer::Pass pass;
+    if(skipping)
+    {
+      pass.index = j;
+      pass.next = j < count - 1 ? j + 1 : -1;
+    }
+    // the first pass starts its rays at the bounding sphere, the last
+    // keeps them going until they resolve
+    if(banded)
+    {
+      pass.continues = j > 0;
+      pass.bandFar = j < count - 1 ? std::exp2(bands[j]) : 0.f;
+      pass.stepBudget = j < count - 1 ? steps_per_layer : mandel.data.intersect_step_count;
+    }
+    i->redraw(cam, mandelShader, mandel, dBuf, j == count - 1, face_scale, pass);
     dBuf = i->getMarchDepthBuf();
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Is this necessary?
+    // the next pass draws from what this one wrote into its command, and
+    // starts where its rays stopped
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
   }
-  i->redraw(cam, mandelShader, mandel, dBuf, true);
+  bandsMeasured = banded;
+  if(skipping)
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  
+  // keep the commands for `marchedPasses`, in the other read buffer than
+  // last time, superseding a still pending read of this one
+  passLatest = 1 - passLatest;
+  if(passFences[passLatest])
+    glDeleteSync(passFences[passLatest]);
+  passReadCounts[passLatest] = passCount;
+  glBindBuffer(GL_COPY_WRITE_BUFFER, passReadBufs[passLatest]);
+  glBufferData(GL_COPY_WRITE_BUFFER, std::max(passCount, 1)*4*sizeof(GLuint), nullptr, GL_STREAM_READ);
+  if(skipping)
+  {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, passBuf);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, passCount*4*sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  passFences[passLatest] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
   //glDisable(GL_STENCIL_TEST);
 }
 
+bool MarchingManager::marchesPlain(MandelRenderer &mandel)
+{
+  return octahedral || MarchingLayer::marchesPlain(mandel, face_scale);
+}
+
+void MarchingManager::chooseDepthFormat(camera &cam, MandelRenderer &mandel)
+{
+  // rays end at ten times the zoom, see the march shader, and packed
+  // depths have to hold that much. Past it they would read as the sky
+  bool packable = !octahedral && mandel.canPackDepth() && MarchingLayer::marchesPlain(mandel, face_scale)
+    && 10.*cam.zoomLevel < std::exp2(static_cast<double>(LayerPool::PACKED_DEPTH_LOG_MAX));
+  depthFormat = depth_format == GL_R16_SNORM && packable ? GL_R16_SNORM : GL_R32F;
+}
+
+void MarchingManager::fitBands(int count)
+{
+  if(static_cast<int>(bands.size()) != count - 1)
+  {
+    // an even start, from just short of the camera's own scale out
+    bands.resize(count - 1);
+    for(int k = 0; k < count - 1; k++)
+      bands[k] = -2.f + 6.f*(k + 1)/count;
+    bandsMeasured = false;
+    return;
+  }
+  if(!bandsMeasured)
+    return;
+  
+  // the work of the last redraw the step counts are back for, front to
+  // back. That lags a frame or so, which the damping rides out
+  std::vector<double> work;
+  double total = 0.;
+  for(auto i = layers.rbegin(); i != layers.rend(); i++)
+  {
+    work.push_back(i->getStepCount());
+    total += work.back();
+  }
+  if(total <= 0.)
+    return;
+  
+  // the steps taken up to each band edge, spread evenly over the log
+  // distances within a band. The open bands on either end are taken to be
+  // as wide as the ones between
+  float width = count > 2 ? (bands.back() - bands.front())/(count - 2) : 1.f;
+  std::vector<float> edge(count + 1);
+  std::vector<double> before(count + 1, 0.);
+  edge[0] = bands.front() - width;
+  edge[count] = bands.back() + width;
+  for(int k = 0; k < count - 1; k++)
+    edge[k + 1] = bands[k];
+  for(int k = 0; k < count; k++)
+    before[k + 1] = before[k] + work[k];
+  
+  // where each layer's even share of the steps would end
+  for(int k = 0; k < count - 1; k++)
+  {
+    double share = total*(k + 1)/count;
+    int j = 0;
+    while(j < count - 1 && before[j + 1] < share)
+      j++;
+    double span = before[j + 1] - before[j];
+    float f = span > 0. ? static_cast<float>((share - before[j])/span) : 0.f;
+    float fitted = edge[j] + f*(edge[j + 1] - edge[j]);
+    bands[k] += fit_rate*(fitted - bands[k]);
+  }
+  
+  // a sliver of an octave at least, in order
+  for(int k = 1; k < count - 1; k++)
+    bands[k] = std::max(bands[k], bands[k - 1] + 1.f/16.f);
+}
+
+void MarchingManager::updateTiles(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel)
+{
+  // as fine as the front layer, its faces having `width` texels at most
+  tiles.update(cam, mandelShader, mandel, layers.back().mappinglevel, width);
+}
 
 void MarchingManager::redraw_if_needed(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel)
 {
-  for(int n = 0; n < NUM_SIDES; n++)
+  // storage for the next change of depth trickles in between frames
+  pool.update();
+  
+  // new sizes or formats leave the faces nothing worth keeping
+  chooseDepthFormat(cam, mandel);
+  for(auto &layer : layers)
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, flushbufs[n]);
-    glClear(GL_STENCIL_BUFFER_BIT);
+    if(layerLayout(layer.mappinglevel, static_cast<int>(layers.size())) != layer.layout)
+    {
+      redraw(cam, mandelShader, mandel);
+      return;
+    }
   }
-  glStencilFunc(GL_EQUAL, 0x01, 0x01);
-  glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
   
-  GLuint dBuf = dummyDepthBuf;
+  // an undulating julia point changes the fractal itself every frame, and
+  // after any other geometry edit there is nothing left worth reprojecting
+  bool redraw_needed = !reproject || mandel.data.juliaMoves();
+  for(auto &layer : layers)
+  {
+    redraw_needed = redraw_needed || !layer.hasGeometry(mandel.geometryRevision());
+  }
   
-  bool redraw_needed = true;
+  for(auto i = layers.begin(); i != layers.end() && !redraw_needed; i++)
+  {
+    redraw_needed = i->isStale(cam, reproject_radius);
+  }
   
-  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Is this necessary?
-  auto i = layers.rbegin();
-  for(unsigned int j = 0; j < layers.size() - 1; i++, j++)
+  // layers still holding this exact march can at most need shading again
+  bool current = true;
+  for(auto &layer : layers)
+  {
+    current = current && layer.isCurrent(cam, mandel.geometryRevision());
+  }
+  if(redraw_needed && !current)
   {
-    if(redraw_needed)
+    redraw(cam, mandelShader, mandel);
+    return;
+  }
+  
+  // color edits, where a layer has no usable g-buffer it all gets marched
+  for(auto &layer : layers)
+  {
+    if(!layer.isShaded(mandel.shadingRevision()) && !layer.canReshade())
     {
-      i->redraw(cam, mandelShader, mandel, dBuf, false);
+      redraw(cam, mandelShader, mandel);
+      return;
     }
-    dBuf = i->getMarchDepthBuf();
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT); // Is this necessary?
   }
-  if(redraw_needed)
+  for(auto &layer : layers)
   {
-    i->redraw(cam, mandelShader, mandel, dBuf, true);
+    if(!layer.isShaded(mandel.shadingRevision()))
+      layer.reshade(mandelShader, mandel);
   }
 }
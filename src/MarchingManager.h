@@ -2,29 +2,152 @@
 #define __MARCHINGMANAGER_H
 
 #include <list>
+#include <vector>
 
 #include "MarchingLayer.h"
+#include "TileCache.h"
 
 class MarchingManager
 {
+  // the layers hand their faces back on the way out, so it goes last
+  LayerPool pool;
   // A list is used to avoid spurious destructions which would wreak havoc with GL buffer names
   std::list<MarchingLayer> layers;
   std::array<GLuint, NUM_SIDES> flushbufs;
   GLuint stencilArray, dummyDepthBuf;
+  // one indirect draw command per layer pass of the last redraw, deepest
+  // first, see redraw. Copied into one of `passReadBufs` after each
+  // redraw, with the pass count then and a fence, for `marchedPasses` to
+  // read back once the copy is done
+  GLuint passBuf;
+  GLuint passReadBufs[2];
+  GLsync passFences[2];
+  int passReadCounts[2];
+  int passLatest;
+  int passCount, marchedCount;
   int width, height;
-  int steps_per_layer = 32;
+  // log2 of the world space distances the layers hand their rays over
+  // at, nearest first, one fewer than there are layers
+  std::vector<float> bands;
+  // whether the last redraw marched with `bands`, so its step counts tell
+  // how to move them
+  bool bandsMeasured;
+  // the depth format the layers are stored in, `depth_format` unless the
+  // last redraw couldn't use it
+  GLenum depthFormat;
   
   void createTextures();
+  // sets `depthFormat` to what a redraw from `cam` can store
+  void chooseDepthFormat(camera &cam, MandelRenderer &mandel);
+  // whether the layers march every pixel themselves, see
+  // MarchingLayer::marchesPlain
+  bool marchesPlain(MandelRenderer &mandel);
+  // moves `bands` so each of `count` layers takes about as many steps
+  void fitBands(int count);
+  // the size and formats of the layer at `mappinglevel` out of `count`
+  LayerPool::Layout layerLayout(int mappinglevel, int count);
+  // hands back the faces of the layers whose layout changes at `count`
+  // layers
+  void releaseResized(int count);
+  // gives every layer the layout its place in the onion calls for, and has
+  // the pool ready with what one more layer would need
+  void resizeLayers();
+  // draws `run`, front to back, in one full screen pass. Where none of
+  // them resolved a pixel it is left as it was. With `tiled` the detail
+  // tiles go in front of all of them
+  void composite(camera &cam, std::vector<MarchingLayer*> &run, bool reproject, glm::vec3 eyeOffset, glm::vec2 size, std::shared_ptr<Program> &compositeShader, bool tiled = false);
 
 public:
   std::vector<char> layer_display_list;
+  
+  // when set, layers are warped to the current eye position, and only
+  // re-marched once the eye leaves `reproject_radius` (in fractal space)
+  bool reproject = false;
+  float reproject_radius = 0.05f;
+  
+  // in stereo, layers whose nearest surface shifts by more than this many
+  // pixels between the eyes get marched per eye instead of shared
+  float parallax_limit = 4.f;
+  
+  // fraction of each face marched along each axis, for dynamic resolution
+  float face_scale = 1.f;
+  
+  // when set, each layer is a single equal area octahedral map of every
+  // direction instead of six cube faces. Matching the resolution the faces
+  // have at their centers takes about half the pixels, as they don't crowd
+  // into the corners. They are always marched plainly, a draw each, and
+  // keep their depths in GL_R32F
+  bool octahedral = false;
+  
+  // when set, layer passes after one that resolved every pixel of its
+  // faces are skipped on the GPU, without waiting on a readback. Only for
+  // plain marches, the others always get drawn
+  bool skip_resolved = true;
+  
+  // when set, plain marches split each ray between the layers by distance,
+  // the front layer marching the nearest stretch and handing what it left
+  // over to the next. The bands are fitted to the steps each layer took,
+  // so every layer does about the same work
+  bool fit_layers = true;
+  // steps a ray gets in each layer but the last, which exhausts it
+  int steps_per_layer = 32;
+  // how far the bands move towards their fit with each redraw
+  float fit_rate = .5f;
+  
+  // resolution of each layer behind the front one, along each axis, as a
+  // fraction of the one in front of it. Layers further out march with
+  // fewer iterations and resolve less, so they need fewer pixels
+  float layer_scale_falloff = .5f;
+  float min_layer_scale = .25f;
+  
+  // what the layers' colors are stored as, see LayerPool::colorFormats,
+  // from the front layer back. Layers past the end take the last one
+  std::vector<GLenum> color_formats = { GL_RGBA8 };
+  // GL_R32F, or GL_R16_SNORM for log packed depths. Those are only
+  // written by plain layered marches, and only hold distances out to
+  // LayerPool::PACKED_DEPTH_LOG_MAX, anything else falls back to GL_R32F
+  GLenum depth_format = GL_R32F;
+  // the formats layer `layer` is stored in, from the back
+  const LayerPool::Layout &getLayout(int layer);
+  // whether the last redraw had to store depths in GL_R32F against
+  // `depth_format`
+  bool depthFellBack();
+  
+  // finer cube faces than the layers, marched a tile at a time where the
+  // view looks closely enough, and only while the camera holds still.
+  // Shown in front of the layers by `draw`, not by `drawEye`
+  TileCache tiles;
+  // streams in the tiles the last draw asked for, once a frame. Still
+  // frames included, they are the ones the tiles are for
+  void updateTiles(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel);
+  
+  // texture memory the layers hold, and what the pool keeps idle, in bytes
+  size_t getMemoryUsage();
+  size_t getIdleMemory();
 
   void setDepth(unsigned int depth);
   int getDepth();
   
   GLuint getDepthBufArray(int layer);
+  int getUnresolvedCount(int layer);
+  double getStepCount(int layer);
+  // the hand over distances in world units, nearest first, empty unless
+  // the last redraw was split by distance
+  std::vector<float> getBands();
+  // how many of the passes of the last finished redraw were drawn, out of
+  // its pass count. Never waits on the march, so may lag a frame or so
+  int marchedPasses();
+  int getPassCount();
+  
+  // the most layers a single composite pass takes, more go in several.
+  // Two samplers each, and two more for the tiles, fit the 16 texture
+  // units GL 4.3 guarantees a fragment shader. Matches composite.fs
+  static const int MAX_COMPOSITE_LAYERS = 7;
   
-  void draw(camera &cam, std::shared_ptr<Program> &ccSphereshader);
+  void draw(camera &cam, std::shared_ptr<Program> &compositeShader, glm::vec2 size);
+  // draws the view of one eye, offset from the camera by `eyeOffset` in
+  // world space, reprojecting the shared layers where parallax allows it
+  void drawEye(camera &cam, glm::vec3 eyeOffset, glm::vec2 size, std::shared_ptr<Program> &compositeShader, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel);
   void redraw(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel);
   void redraw_if_needed(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel);
   
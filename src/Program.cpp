@@ -11,6 +11,30 @@ void Program::setShaderNames(const std::string &v, const std::string &f)
 {
 	vShaderName = v;
 	fShaderName = f;
+	gShaderName.clear();
+}
+
+void Program::setShaderNames(const std::string &v, const std::string &f, const std::string &g)
+{
+	vShaderName = v;
+	fShaderName = f;
+	gShaderName = g;
+}
+
+void Program::addDefine(const std::string &name)
+{
+	defines += "#define " + name + "\n";
+}
+
+// `source` with `defines` following its #version line, which has to stay first
+static std::string withDefines(const std::string &source, const std::string &defines)
+{
+	if (defines.empty())
+		return source;
+	size_t line = source.compare(0, 8, "#version") == 0 ? source.find('\n') : std::string::npos;
+	if (line == std::string::npos)
+		return defines + source;
+	return source.substr(0, line + 1) + defines + source.substr(line + 1);
 }
 
 bool Program::init()
@@ -22,8 +46,8 @@ bool Program::init()
 	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
 
 	// Read shader sources
-	std::string vShaderString = readFileAsString(vShaderName);
-	std::string fShaderString = readFileAsString(fShaderName);
+	std::string vShaderString = withDefines(readFileAsString(vShaderName), defines);
+	std::string fShaderString = withDefines(readFileAsString(fShaderName), defines);
 	const char *vshader = vShaderString.c_str();
 	const char *fshader = fShaderString.c_str();
 	CHECKED_GL_CALL(glShaderSource(VS, 1, &vshader, NULL));
@@ -55,10 +79,33 @@ bool Program::init()
 		return false;
 	}
 
+	// Compile geometry shader, if there is one
+	GLuint GS = 0;
+	if (!gShaderName.empty())
+	{
+		GS = glCreateShader(GL_GEOMETRY_SHADER);
+		std::string gShaderString = withDefines(readFileAsString(gShaderName), defines);
+		const char *gshader = gShaderString.c_str();
+		CHECKED_GL_CALL(glShaderSource(GS, 1, &gshader, NULL));
+		CHECKED_GL_CALL(glCompileShader(GS));
+		CHECKED_GL_CALL(glGetShaderiv(GS, GL_COMPILE_STATUS, &rc));
+		if (!rc)
+		{
+			if (isVerbose())
+			{
+				GLSL::printShaderInfoLog(GS);
+				std::cout << "Error compiling geometry shader " << gShaderName << std::endl;
+			}
+			return false;
+		}
+	}
+
 	// Create the program and link
 	pid = glCreateProgram();
 	CHECKED_GL_CALL(glAttachShader(pid, VS));
 	CHECKED_GL_CALL(glAttachShader(pid, FS));
+	if (GS)
+		CHECKED_GL_CALL(glAttachShader(pid, GS));
 	CHECKED_GL_CALL(glLinkProgram(pid));
 	CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
 	if (!rc)
@@ -18,6 +18,11 @@ public:
 	bool isVerbose() const { return verbose; }
 
 	void setShaderNames(const std::string &v, const std::string &f);
+	// with a geometry shader `g` between the two
+	void setShaderNames(const std::string &v, const std::string &f, const std::string &g);
+	// defines `name` in every shader, right after its #version line.
+	// Takes effect on the next init
+	void addDefine(const std::string &name);
 	virtual bool init();
 	virtual void bind();
 	virtual void unbind();
@@ -31,6 +36,8 @@ protected:
 
 	std::string vShaderName;
 	std::string fShaderName;
+	std::string gShaderName;
+	std::string defines;
 
 private:
 
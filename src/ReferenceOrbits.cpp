@@ -0,0 +1,266 @@
+#include "ReferenceOrbits.h"
+
+#include <cmath>
+#include <algorithm>
+
+// the shader's bulbPower, in doubles
+static glm::dvec3 bulbPower(glm::dvec3 w, int modulo)
+{
+  double r = glm::length(w);
+  if(r == 0.)
+    return glm::dvec3(0);
+  double b = modulo*std::acos(glm::clamp(w.y/r, -1., 1.));
+  double a = modulo*std::atan2(w.x, w.z);
+  return std::pow(r, modulo)*glm::dvec3(std::sin(b)*std::sin(a), std::cos(b), std::sin(b)*std::cos(a));
+}
+
+// the same in fixed point, with the power of 8 in IQ's polynomial form.
+// Its inverse power of x² + z² would leave the fixed point range near the
+// y axis, so (x, z) gets split into a unit direction (a, b) and a length q,
+// every factor of the polynomial staying bounded
+template<int N>
+static FixedVec3<N> bulbPower(const FixedVec3<N> &w, int modulo)
+{
+  typedef FixedPoint<N> F;
+  F x2 = w.x*w.x, y2 = w.y*w.y, z2 = w.z*w.z;
+
+  if(modulo != 8)
+  {
+    // the magnitude stays precise, the angles only get doubles
+    F r2 = x2 + y2 + z2;
+    if(r2.isZero())
+      return FixedVec3<N>();
+    F r = r2*F::inverseSqrt(r2);
+    F rn(1.);
+    for(int i = 0; i < modulo; i++)
+      rn = rn*r;
+    glm::dvec3 dir = bulbPower(w.toDouble(), modulo);
+    dir /= std::max(glm::length(dir), 1e-300);
+    FixedVec3<N> p;
+    p.x = rn*F(dir.x);
+    p.y = rn*F(dir.y);
+    p.z = rn*F(dir.z);
+    return p;
+  }
+
+  F x4 = x2*x2, y4 = y2*y2, z4 = z2*z2;
+  F k3 = x2 + z2;
+  F k4 = k3 - y2;
+  F k1 = x4 + y4 + z4 - (y2*z2 + x2*y2)*F(6.) + x2*z2*F(2.);
+
+  F a(1.), b, q;
+  if(!k3.isZero())
+  {
+    // scaled up to about unit length first, so the inverse square root
+    // stays in range however close to the axis it is
+    double largest = std::max(std::fabs(w.x.toDouble()), std::fabs(w.z.toDouble()));
+    int e = -static_cast<int>(std::floor(std::log2(largest)));
+    F xs = w.x.scaled(e), zs = w.z.scaled(e);
+    F k = xs*xs + zs*zs;
+    F s = F::inverseSqrt(k);
+    a = xs*s;
+    b = zs*s;
+    q = (k*s).scaled(-e);
+  }
+  F a2 = a*a, b2 = b*b;
+  F a4 = a2*a2, b4 = b2*b2, a2b2 = a2*b2;
+  F yk = w.y*k4*k1*q;
+
+  FixedVec3<N> p;
+  p.x = yk*a*b*(a2 - b2)*(a4 - a2b2*F(6.) + b4)*F(64.);
+  p.y = k1*k1 - y2*k3*k4*k4*F(16.);
+  p.z = -(yk*(a4*a4 - (a4*a2b2 + a2b2*b4)*F(28.) + a4*b4*F(70.) + b4*b4)*F(8.));
+  return p;
+}
+
+// the shader's map, following `point` in fixed point for as long as the
+// integer limb can hold its powers. Past that it is escaping anyway, and
+// the rest of the orbit goes on in doubles
+template<int N>
+static void iterate(const FixedVec3<N> &point, const ReferenceOrbits::Params &params, ReferenceOrbits::Orbit &orbit)
+{
+  typedef FixedPoint<N> F;
+  int modulo = std::max(params.modulo, 2);
+  double fixedRadius = std::min(2., std::pow(2., 30./modulo));
+
+  // mix(p, jp, f), as in the shader
+  double f = glm::clamp(params.julia_factor, 0., 1.);
+  FixedVec3<N> c;
+  c.x = point.x*F(1. - f) + F(params.julia_point.x*f);
+  c.y = point.y*F(1. - f) + F(params.julia_point.y*f);
+  c.z = point.z*F(1. - f) + F(params.julia_point.z*f);
+  glm::dvec3 cd = c.toDouble();
+
+  FixedVec3<N> w = point;
+  glm::dvec3 wd = point.toDouble();
+  double m = glm::dot(wd, wd);
+  double dz = params.start_offset;
+  bool fixed = true;
+  orbit.points.push_back(wd);
+  orbit.derivatives.push_back(dz);
+
+  for(int i = 0; i < std::max(params.iterations, 1); i++)
+  {
+    dz = modulo*std::pow(std::sqrt(m), modulo - 1.)*dz + 1.;
+    fixed = fixed && std::sqrt(m) <= fixedRadius;
+    if(fixed)
+    {
+      w = c + bulbPower(w, modulo);
+      wd = w.toDouble();
+    }
+    else
+    {
+      wd = cd + bulbPower(wd, modulo);
+    }
+    m = glm::dot(wd, wd);
+    orbit.points.push_back(wd);
+    orbit.derivatives.push_back(dz);
+    if(m > modulo*modulo)
+    {
+      orbit.escaped = true;
+      break;
+    }
+  }
+
+  orbit.distance = .25*std::log(m)*std::sqrt(m)/dz;
+}
+
+void ReferenceOrbits::init()
+{
+  // one core left to the render thread
+  unsigned threads = std::thread::hardware_concurrency();
+  threads = std::min(std::max(threads, 2u), 5u) - 1;
+  for(unsigned i = 0; i < threads; i++)
+    workers.emplace_back(&ReferenceOrbits::work, this);
+}
+
+ReferenceOrbits::~ReferenceOrbits()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(std::thread &worker : workers)
+    worker.join();
+}
+
+std::shared_ptr<const ReferenceOrbits::Orbit> ReferenceOrbits::request(const Point &point, const Params &params)
+{
+  if(workers.empty())
+    return nullptr;
+
+  std::string key = keyOf(point, params);
+  std::lock_guard<std::mutex> lock(mutex);
+  recency.remove(key);
+  recency.push_back(key);
+  auto found = orbits.find(key);
+  if(found != orbits.end())
+    return found->second;
+
+  // only the latest few requests are worth working on, the others make way
+  while(queue.size() >= workers.size())
+  {
+    orbits.erase(queue.front().key);
+    recency.remove(queue.front().key);
+    queue.pop_front();
+  }
+  Job job;
+  job.key = key;
+  job.point = point;
+  job.params = params;
+  queue.push_back(job);
+  orbits[key] = nullptr;
+  wake.notify_one();
+
+  // the orbits still being worked on stay
+  for(auto i = recency.begin(); i != recency.end() && static_cast<int>(orbits.size()) > max_cached;)
+  {
+    auto orbit = orbits.find(*i);
+    if(orbit != orbits.end() && orbit->second)
+    {
+      orbits.erase(orbit);
+      i = recency.erase(i);
+    }
+    else
+    {
+      ++i;
+    }
+  }
+  return nullptr;
+}
+
+int ReferenceOrbits::cached()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  int count = 0;
+  for(auto &orbit : orbits)
+    count += orbit.second != nullptr;
+  return count;
+}
+
+int ReferenceOrbits::pending()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  int count = 0;
+  for(auto &orbit : orbits)
+    count += orbit.second == nullptr;
+  return count;
+}
+
+void ReferenceOrbits::work()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    wake.wait(lock, [this] { return stopping || !queue.empty(); });
+    if(stopping)
+      return;
+    Job job = queue.front();
+    queue.pop_front();
+
+    lock.unlock();
+    std::shared_ptr<const Orbit> orbit = compute(job.point, job.params);
+    lock.lock();
+
+    auto entry = orbits.find(job.key);
+    if(entry != orbits.end())
+      entry->second = orbit;
+  }
+}
+
+std::string ReferenceOrbits::keyOf(const Point &point, const Params &params)
+{
+  // the exact bits, byte by byte
+  std::string key;
+  auto append = [&key](const void *data, size_t bytes) {
+    key.append(static_cast<const char *>(data), bytes);
+  };
+  const FixedPoint<8> *coords[] = { &point.x, &point.y, &point.z };
+  for(const FixedPoint<8> *c : coords)
+  {
+    append(c->limb, sizeof(c->limb));
+    append(&c->negative, sizeof(c->negative));
+  }
+  append(&params.modulo, sizeof(params.modulo));
+  append(&params.iterations, sizeof(params.iterations));
+  append(&params.start_offset, sizeof(params.start_offset));
+  // the point only counts as much as it is mixed in, so a point
+  // without weight doesn't split the cache
+  double f = glm::clamp(params.julia_factor, 0., 1.);
+  glm::dvec3 julia = params.julia_point*f;
+  append(&f, sizeof(f));
+  append(&julia, sizeof(julia));
+  append(&params.bits, sizeof(params.bits));
+  return key;
+}
+
+std::shared_ptr<const ReferenceOrbits::Orbit> ReferenceOrbits::compute(const Point &point, const Params &params)
+{
+  std::shared_ptr<Orbit> orbit = std::make_shared<Orbit>();
+  if(params.bits <= 128)
+    iterate(point.resized<4>(), params, *orbit);
+  else
+    iterate(point, params, *orbit);
+  return orbit;
+}
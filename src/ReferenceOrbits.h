@@ -0,0 +1,91 @@
+#ifndef __REFERENCEORBITS_H
+#define __REFERENCEORBITS_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "FixedPoint.h"
+
+// Orbits of single reference points through the bulb's map, worked out on
+// the CPU in fixed point at zooms no float type on the GPU can place. The
+// map is a port of the march shader's and gives the same distance estimate.
+// A pool of threads does the work, the render thread only ever picks up
+// finished orbits, and those are cached by the exact point and settings
+// they were asked for.
+class ReferenceOrbits
+{
+public:
+  // points are asked for at the most precision there is
+  typedef FixedVec3<8> Point;
+
+  // what an orbit depends on besides its point
+  struct Params
+  {
+    int modulo = 8;
+    int iterations = 4;
+    double start_offset = 1.;
+    double julia_factor = 0.;
+    glm::dvec3 julia_point = glm::dvec3(0);
+    // 128 or 256
+    int bits = 256;
+  };
+
+  struct Orbit
+  {
+    // every iterate from the reference point on, rounded to doubles
+    std::vector<glm::dvec3> points;
+    // the running derivative at each of them
+    std::vector<double> derivatives;
+    // map()'s distance estimate at the reference point, in fractal space
+    double distance = 0.;
+    // whether it left the bail out radius before running out of iterations
+    bool escaped = false;
+  };
+
+  bool enabled = false;
+  // 128 or 256
+  int bits = 256;
+  int max_iterations = 128;
+  // orbits kept around, the least recently asked for going first
+  int max_cached = 64;
+
+  // starts the workers
+  void init();
+  ~ReferenceOrbits();
+
+  // the orbit of `point`, or null until a worker has it. Asking again for
+  // one that is being worked on doesn't queue it twice
+  std::shared_ptr<const Orbit> request(const Point &point, const Params &params);
+  int cached();
+  int pending();
+
+private:
+  struct Job
+  {
+    std::string key;
+    Point point;
+    Params params;
+  };
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::deque<Job> queue;
+  // finished orbits, and null for the ones still queued or being worked on
+  std::map<std::string, std::shared_ptr<const Orbit>> orbits;
+  // keys from the least to the most recently asked for
+  std::list<std::string> recency;
+
+  void work();
+  static std::string keyOf(const Point &point, const Params &params);
+  static std::shared_ptr<const Orbit> compute(const Point &point, const Params &params);
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "Refiner.h"
+
+#include <iostream>
+
+// for the unit plane
+#include "MandelRenderer.h"
+
+// radical inverse of `index`, for spreading the jitter over the pixel
+static float halton(int index, int base)
+{
+  float f = 1.f, r = 0.f;
+  while(index > 0)
+  {
+    f /= base;
+    r += f*(index % base);
+    index /= base;
+  }
+  return r;
+}
+
+void Refiner::init(const std::string &resourceDirectory)
+{
+  accumShader = std::make_shared<Program>();
+  accumShader->setVerbose(true);
+  accumShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/accumulate.fs");
+  if (!accumShader->init())
+  {
+    std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+    exit(1);
+  }
+  accumShader->addAttribute("vertPos");
+  accumShader->addUniform("sampleColor");
+  accumShader->addUniform("weight");
+}
+
+Refiner::~Refiner()
+{
+  if(accumFramebuf)
+  {
+    glDeleteTextures(1, &accumTex);
+    glDeleteTextures(1, &sampleTex);
+    glDeleteFramebuffers(1, &accumFramebuf);
+    glDeleteFramebuffers(1, &sampleFramebuf);
+  }
+}
+
+void Refiner::resize(int w, int h)
+{
+  if(accumFramebuf)
+  {
+    glDeleteTextures(1, &accumTex);
+    glDeleteTextures(1, &sampleTex);
+    glDeleteFramebuffers(1, &accumFramebuf);
+    glDeleteFramebuffers(1, &sampleFramebuf);
+  }
+  width = w;
+  height = h;
+  samples = 0;
+  
+  glGenTextures(1, &accumTex);
+  glGenTextures(1, &sampleTex);
+  glGenFramebuffers(1, &accumFramebuf);
+  glGenFramebuffers(1, &sampleFramebuf);
+  
+  // the average keeps more precision than a sample has
+  glBindTexture(GL_TEXTURE_2D, accumTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, width, height);
+  glBindTexture(GL_TEXTURE_2D, sampleTex);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, accumFramebuf);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, accumTex, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, sampleFramebuf);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sampleTex, 0);
+}
+
+bool Refiner::update(camera &cam, MandelRenderer &mandel, glm::vec2 size)
+{
+  // refined samples march without the display settings, so only geometry
+  // and shading count. With a weighted julia point moving nothing is still
+  bool same = haveLast
+    && !mandel.data.juliaMoves()
+    && !(mandel.dirty() & (MandelRenderer::DIRTY_GEOMETRY | MandelRenderer::DIRTY_SHADING))
+    && cam.position() == lastPos && cam.pitch == lastPitch && cam.yaw == lastYaw
+    && cam.zoomLevel == lastZoom
+    && static_cast<int>(size.x) == width && static_cast<int>(size.y) == height;
+  
+  lastPos = cam.position();
+  lastPitch = cam.pitch;
+  lastYaw = cam.yaw;
+  lastZoom = cam.zoomLevel;
+  haveLast = true;
+  
+  if(!enabled || !same)
+  {
+    stillFrames = 0;
+    samples = 0;
+    if(static_cast<int>(size.x) != width || static_cast<int>(size.y) != height)
+      resize(size.x, size.y);
+    return false;
+  }
+  
+  stillFrames++;
+  return stillFrames >= settle_frames;
+}
+
+bool Refiner::converged()
+{
+  return samples >= max_samples;
+}
+
+int Refiner::sampleCount()
+{
+  return samples;
+}
+
+MandelRenderer::RenderData Refiner::nextSample(const MandelRenderer::RenderData &dat)
+{
+  MandelRenderer::RenderData s = dat;
+  s.intersect_step_count = static_cast<int>(dat.intersect_step_count*step_boost);
+  s.intersect_threshold = dat.intersect_threshold/step_boost;
+  s.iter_boost = iter_boost;
+  s.shadow_steps = static_cast<int>(dat.shadow_steps*shadow_boost);
+  s.shadow_sharpness = dat.shadow_sharpness*shadow_boost;
+  // nothing is gained skimping on a frame that gets shown for a while
+  s.foveated = 0;
+  s.interleave = 1;
+  // every sample is a march of its own
+  s.deferred = 0;
+  s.jitter = glm::vec2(halton(samples + 1, 2), halton(samples + 1, 3)) - .5f;
+  return s;
+}
+
+void Refiner::beginSample(glm::vec2 size)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, sampleFramebuf);
+  glViewport(0, 0, size.x, size.y);
+}
+
+void Refiner::accumulate(glm::vec2 size)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, accumFramebuf);
+  glViewport(0, 0, size.x, size.y);
+  
+  accumShader->bind();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, sampleTex);
+  glUniform1i(accumShader->getUniform("sampleColor"), 0);
+  // blended in with a weight of 1/n keeps the mean of all n
+  glUniform1f(accumShader->getUniform("weight"), 1.f/(samples + 1));
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  accumShader->unbind();
+  
+  samples++;
+}
+
+void Refiner::present(glm::vec2 size, GLuint target)
+{
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, accumFramebuf);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,64 @@
+#ifndef __REFINER_H
+#define __REFINER_H
+
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Program.h"
+#include "camera.h"
+#include "MandelRenderer.h"
+
+// Progressive refinement of still frames. Once neither the camera nor the
+// render settings change, each frame marches one more jittered sample with
+// raised budgets into a running average, until `max_samples` are in. From
+// then on the average just gets presented again, with no marching at all.
+class Refiner
+{
+  GLuint accumFramebuf = 0, accumTex = 0;
+  GLuint sampleFramebuf = 0, sampleTex = 0;
+  int width = 0, height = 0;
+  std::shared_ptr<Program> accumShader;
+  
+  // where the last frame was drawn from
+  glm::dvec3 lastPos;
+  double lastPitch = 0., lastYaw = 0.;
+  double lastZoom = 0.;
+  bool haveLast = false;
+  
+  int stillFrames = 0;
+  int samples = 0;
+  
+  void resize(int w, int h);
+public:
+  bool enabled = true;
+  int max_samples = 64;
+  // unchanged frames before refining starts, so a pause mid-motion
+  // doesn't flicker in and out of it
+  int settle_frames = 2;
+  // budget raises for refined samples
+  float step_boost = 2.f;
+  int iter_boost = 2;
+  float shadow_boost = 2.f;
+  
+  void init(const std::string &resourceDirectory);
+  ~Refiner();
+  
+  // records the state of this frame, true when it should be refined
+  // rather than drawn the usual way. Expects `mandel` to have already
+  // diffed its settings for the frame
+  bool update(camera &cam, MandelRenderer &mandel, glm::vec2 size);
+  // true once the average has all its samples
+  bool converged();
+  int sampleCount();
+  
+  // `dat` with the raised budgets and the jitter of the next sample
+  MandelRenderer::RenderData nextSample(const MandelRenderer::RenderData &dat);
+  // binds the target the next sample gets marched into
+  void beginSample(glm::vec2 size);
+  void accumulate(glm::vec2 size);
+  // draws the average into `target`
+  void present(glm::vec2 size, GLuint target);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "ResolutionScaler.h"
+
+#include <cmath>
+#include <algorithm>
+
+void ResolutionScaler::init()
+{
+  glGenQueries(SCALER_QUERY_COUNT, queries.data());
+}
+
+void ResolutionScaler::beginFrame()
+{
+  timing = enabled;
+  if(!timing)
+    return;
+  glBeginQuery(GL_TIME_ELAPSED, queries[queryFrame % SCALER_QUERY_COUNT]);
+}
+
+void ResolutionScaler::endFrame()
+{
+  if(!timing)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  queryFrame++;
+  
+  // the oldest query has had a few frames to finish by now
+  if(queryFrame < SCALER_QUERY_COUNT)
+    return;
+  GLuint oldest = queries[queryFrame % SCALER_QUERY_COUNT];
+  GLint available = 0;
+  glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+  if(available)
+  {
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed);
+    adjust(elapsed/1e6f);
+  }
+}
+
+void ResolutionScaler::adjust(float gpuMs)
+{
+  last_gpu_ms = gpuMs;
+  
+  if(gpuMs > target_ms*(1.f + hysteresis))
+  {
+    overBudget++;
+    underBudget = 0;
+  }
+  else if(gpuMs < target_ms*(1.f - hysteresis))
+  {
+    underBudget++;
+    overBudget = 0;
+  }
+  else
+  {
+    overBudget = underBudget = 0;
+  }
+  
+  if(overBudget < settle_frames && underBudget < settle_frames)
+    return;
+  
+  // marching cost follows the pixel count, so the square of the scale
+  float factor = std::sqrt(target_ms/std::max(gpuMs, 1e-3f));
+  // growing is done carefully, as overshooting shows up as a hitch
+  factor = std::min(std::max(factor, .5f), 1.1f);
+  scale = std::min(std::max(scale*factor, min_scale), max_scale);
+  overBudget = underBudget = 0;
+}
+
+glm::vec2 ResolutionScaler::scaledSize(glm::vec2 size)
+{
+  if(!enabled)
+    return size;
+  return glm::max(glm::floor(size*scale), glm::vec2(1));
+}
+
+glm::vec2 ResolutionScaler::bind(glm::vec2 size)
+{
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  if(w != targetWidth || h != targetHeight)
+  {
+    if(framebuf)
+    {
+      glDeleteTextures(1, &colorTex);
+      glDeleteFramebuffers(1, &framebuf);
+    }
+    targetWidth = w;
+    targetHeight = h;
+    
+    glGenTextures(1, &colorTex);
+    glGenFramebuffers(1, &framebuf);
+    glBindTexture(GL_TEXTURE_2D, colorTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTex, 0);
+  }
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuf);
+  boundSize = scaledSize(size);
+  return boundSize;
+}
+
+void ResolutionScaler::present(glm::vec2 size, GLuint target)
+{
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuf);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  glBlitFramebuffer(0, 0, boundSize.x, boundSize.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
@@ -0,0 +1,55 @@
+#ifndef __RESOLUTIONSCALER_H
+#define __RESOLUTIONSCALER_H
+
+#include <array>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+#define SCALER_QUERY_COUNT 4
+
+// Scales the internal render resolution to hold a frame time target,
+// measured on the GPU with timer queries. Results are read a few frames
+// late so the queries never stall the pipeline.
+class ResolutionScaler
+{
+  std::array<GLuint, SCALER_QUERY_COUNT> queries;
+  int queryFrame = 0;
+  bool timing = false;
+  
+  // consecutive frames spent above or below the hysteresis band
+  int overBudget = 0, underBudget = 0;
+  
+  // offscreen target, allocated at full size and drawn into partially
+  GLuint framebuf = 0, colorTex = 0;
+  int targetWidth = 0, targetHeight = 0;
+  glm::vec2 boundSize;
+  
+  void adjust(float gpuMs);
+public:
+  bool enabled = false;
+  float target_ms = 1000.f/90.f;
+  // scale applied along each axis
+  float scale = 1.f;
+  float min_scale = .25f;
+  float max_scale = 1.f;
+  // frame times within this fraction of the target leave the scale alone
+  float hysteresis = .1f;
+  // frames in a row outside of the band before the scale moves
+  int settle_frames = 8;
+  float last_gpu_ms = 0.f;
+  
+  void init();
+  
+  void beginFrame();
+  void endFrame();
+  
+  glm::vec2 scaledSize(glm::vec2 size);
+  
+  // binds an offscreen target to render `size` at the current scale into
+  // Returns the scaled size
+  glm::vec2 bind(glm::vec2 size);
+  // upscales what was rendered since `bind` into `target`
+  void present(glm::vec2 size, GLuint target);
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "TileCache.h"
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+TileCache::TileCache()
+{
+}
+
+TileCache::~TileCache()
+{
+  release();
+}
+
+int TileCache::tilesPerSide(int level)
+{
+  return (builtSize/TILE_SIZE) >> level;
+}
+
+int TileCache::levelOffset(int level)
+{
+  int offset = 0;
+  for(int l = 0; l < level; l++)
+    offset += NUM_SIDES*tilesPerSide(l)*tilesPerSide(l);
+  return offset;
+}
+
+void TileCache::decode(int index, int &level, int &face, int &x, int &y)
+{
+  // the composite's tileIndex, backwards
+  level = 0;
+  while(level + 1 < levels && index >= levelOffset(level + 1))
+    level++;
+  int n = tilesPerSide(level);
+  int rest = index - levelOffset(level);
+  face = rest/(n*n);
+  rest %= n*n;
+  y = rest/n;
+  x = rest%n;
+}
+
+void TileCache::allocate(int baseSize)
+{
+  builtSize = virtual_size;
+  builtBase = baseSize;
+  builtBudget = memory_budget;
+
+  // levels coarser than the layers would add nothing
+  levels = 0;
+  while((builtSize >> levels) > baseSize && (builtSize >> levels) >= TILE_SIZE)
+    levels++;
+  if(levels == 0)
+    return;
+
+  GLint maxSize;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  double tileBytes = TILE_SIZE*TILE_SIZE*4.;
+  int fits = static_cast<int>(std::sqrt(memory_budget*1024.*1024./tileBytes));
+  slotsPerSide = glm::clamp(fits, 1, maxSize/TILE_SIZE);
+  int side = slotsPerSide*TILE_SIZE;
+
+  glGenTextures(1, &atlas);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, side, side);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  GLint previous;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &atlasFramebuf);
+  glBindFramebuffer(GL_FRAMEBUFFER, atlasFramebuf);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, atlas, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+  // integer textures are incomplete with anything but nearest filtering,
+  // and only ever fetched from anyway
+  int n = tilesPerSide(0);
+  glGenTextures(1, &pageTable);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_R32UI, n, n, NUM_SIDES);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  glGenBuffers(1, &requestBuf);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, requestBuf);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + MAX_REQUESTS)*sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glGenBuffers(1, &flagBuf);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, flagBuf);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, levelOffset(levels)*sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  slotTile.assign(slotsPerSide*slotsPerSide, -1);
+  lastUsed.assign(slotsPerSide*slotsPerSide, 0);
+  tileSlot.assign(levelOffset(levels), -1);
+  flush();
+}
+
+void TileCache::release()
+{
+  glDeleteTextures(1, &atlas);
+  glDeleteTextures(1, &pageTable);
+  glDeleteFramebuffers(1, &atlasFramebuf);
+  glDeleteBuffers(1, &requestBuf);
+  glDeleteBuffers(1, &flagBuf);
+  atlas = pageTable = atlasFramebuf = requestBuf = flagBuf = 0;
+  slotsPerSide = levels = 0;
+  builtSize = builtBase = 0;
+  slotTile.clear();
+  tileSlot.clear();
+  lastUsed.clear();
+  waiting.clear();
+  drained = false;
+  captured = false;
+}
+
+void TileCache::flush()
+{
+  for(int &tile : slotTile)
+  {
+    if(tile >= 0)
+      tileSlot[tile] = -1;
+    tile = -1;
+  }
+
+  std::vector<GLuint> zeros(NUM_SIDES*tilesPerSide(0)*tilesPerSide(0), 0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+  for(int l = 0; l < levels; l++)
+  {
+    int n = tilesPerSide(l);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, 0, n, n, NUM_SIDES, GL_RED_INTEGER, GL_UNSIGNED_INT, zeros.data());
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TileCache::setEntry(int index, int slot)
+{
+  int level, face, x, y;
+  decode(index, level, face, x, y);
+  GLuint entry = slot + 1;
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x, y, face, 1, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, &entry);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+int TileCache::takeSlot()
+{
+  int oldest = -1;
+  for(int i = 0; i < static_cast<int>(slotTile.size()); i++)
+  {
+    if(slotTile[i] < 0)
+      return i;
+    if(lastUsed[i] < frame && (oldest < 0 || lastUsed[i] < lastUsed[oldest]))
+      oldest = i;
+  }
+  if(oldest >= 0)
+  {
+    setEntry(slotTile[oldest], -1);
+    tileSlot[slotTile[oldest]] = -1;
+    slotTile[oldest] = -1;
+  }
+  return oldest;
+}
+
+std::vector<int> TileCache::readRequests()
+{
+  // written through buffer stores by the composite
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, requestBuf);
+  GLuint count = 0;
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+  count = std::min<GLuint>(count, MAX_REQUESTS);
+  std::vector<GLuint> list(count);
+  if(count > 0)
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), count*sizeof(GLuint), list.data());
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, flagBuf);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  std::vector<int> requests;
+  for(GLuint index : list)
+  {
+    if(index < tileSlot.size())
+      requests.push_back(static_cast<int>(index));
+  }
+  return requests;
+}
+
+void TileCache::update(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, int mapIterCount, int baseSize)
+{
+  if(!enabled)
+  {
+    release();
+    return;
+  }
+  if(virtual_size != builtSize || baseSize != builtBase || memory_budget != builtBudget)
+  {
+    release();
+    allocate(baseSize);
+  }
+  if(levels == 0)
+    return;
+  frame++;
+  std::vector<int> requests = readRequests();
+
+  // tiles only hold for the exact view they were marched from, colors
+  // included. A camera on the move would outdate them before they are in,
+  // so nothing gets marched until it holds still
+  glm::dvec3 pos = cam.position();
+  if(!captured || pos != capturePos || cam.zoomLevel != captureZoom
+    || mandel.geometryRevision() != geometryRevision || mandel.shadingRevision() != shadingRevision)
+  {
+    if(residentCount() > 0)
+      flush();
+    captured = true;
+    capturePos = pos;
+    captureZoom = cam.zoomLevel;
+    geometryRevision = mandel.geometryRevision();
+    shadingRevision = mandel.shadingRevision();
+    waiting.clear();
+    drained = false;
+    return;
+  }
+
+  waiting.clear();
+  for(int index : requests)
+  {
+    int slot = tileSlot[index];
+    if(slot >= 0)
+      lastUsed[slot] = frame;
+    else
+      waiting.push_back(index);
+  }
+  drained = waiting.empty();
+  // coarser levels come later in the index, and each of their tiles covers
+  // more of the view
+  std::sort(waiting.begin(), waiting.end(), std::greater<int>());
+
+  GLint previous;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glBindFramebuffer(GL_FRAMEBUFFER, atlasFramebuf);
+  int marched = 0;
+  for(int index : waiting)
+  {
+    if(marched == tiles_per_frame)
+      break;
+    int slot = takeSlot();
+    if(slot < 0)
+    {
+      // the view wants more than fits, nothing else can come in
+      drained = marched == 0;
+      marched = static_cast<int>(waiting.size());
+      break;
+    }
+    int level, face, x, y;
+    decode(index, level, face, x, y);
+    glm::vec2 size(static_cast<float>(builtSize >> level));
+    glm::vec2 origin(x*TILE_SIZE, y*TILE_SIZE);
+    glm::vec2 corner((slot%slotsPerSide)*TILE_SIZE, (slot/slotsPerSide)*TILE_SIZE);
+    mandel.renderTile(mandelShader, capturePos, face, captureZoom, mapIterCount, size, origin, corner, TILE_SIZE);
+    slotTile[slot] = index;
+    tileSlot[index] = slot;
+    lastUsed[slot] = frame;
+    setEntry(index, slot);
+    marched++;
+  }
+  waiting.erase(waiting.begin(), waiting.begin() + marched);
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+bool TileCache::bind(std::shared_ptr<Program> &compositeShader, int firstUnit)
+{
+  // units of their own either way, no two sampler types may share one
+  glUniform1i(compositeShader->getUniform("pageTable"), firstUnit);
+  glUniform1i(compositeShader->getUniform("tileAtlas"), firstUnit + 1);
+  if(!enabled || levels == 0)
+    return false;
+
+  glActiveTexture(GL_TEXTURE0 + firstUnit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, pageTable);
+  glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+  glBindTexture(GL_TEXTURE_2D, atlas);
+  glActiveTexture(GL_TEXTURE0);
+  glUniform1i(compositeShader->getUniform("virtualSize"), builtSize);
+  glUniform1i(compositeShader->getUniform("tileSize"), TILE_SIZE);
+  glUniform1i(compositeShader->getUniform("tileLevels"), levels);
+  glUniform1i(compositeShader->getUniform("atlasSlots"), slotsPerSide);
+  glUniform1i(compositeShader->getUniform("maxTileRequests"), MAX_REQUESTS);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, requestBuf);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, flagBuf);
+  return true;
+}
+
+int TileCache::residentCount()
+{
+  int count = 0;
+  for(int tile : slotTile)
+    count += tile >= 0;
+  return count;
+}
+
+int TileCache::slotCount()
+{
+  return static_cast<int>(slotTile.size());
+}
+
+int TileCache::waitingCount()
+{
+  return static_cast<int>(waiting.size());
+}
+
+bool TileCache::settled()
+{
+  return !enabled || levels == 0 || drained;
+}
+
+int TileCache::levelCount()
+{
+  return levels;
+}
+
+size_t TileCache::memoryUsage()
+{
+  if(levels == 0)
+    return 0;
+  size_t side = static_cast<size_t>(slotsPerSide)*TILE_SIZE;
+  // the page table's levels add up to what the tiles index over
+  return side*side*4 + (tileSlot.size() + (1 + MAX_REQUESTS))*sizeof(GLuint) + tileSlot.size()*sizeof(GLuint);
+}
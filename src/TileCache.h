@@ -0,0 +1,109 @@
+#ifndef __TILECACHE_H
+#define __TILECACHE_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "Program.h"
+#include "MandelRenderer.h"
+
+// Cube faces far finer than the onion layers, virtually: each face is split
+// into square tiles at `virtual_size` and every halving of it, and only the
+// tiles the view actually looks at that closely get marched, whole rays
+// each, from where the camera is. They sit in one atlas of a fixed number
+// of slots, found through a page table with a level for each of the
+// halvings. The composite asks for the tiles its pixels would want, and
+// the requests are picked up the frame after. Missing ones get marched a
+// few a frame, coarsest first, into free slots or the ones asked for least
+// recently. Wherever no tile is in, the layers show through.
+class TileCache
+{
+public:
+  // texels along each side of a tile
+  static const int TILE_SIZE = 64;
+  // the most tile requests a composite can leave, the rest wait on the next
+  static const int MAX_REQUESTS = 4096;
+
+  bool enabled = false;
+  // texels along each side of a face at the finest level, a power of two
+  int virtual_size = 4096;
+  // what the atlas may take, in MB
+  float memory_budget = 64.f;
+  // the most tiles marched a frame
+  int tiles_per_frame = 16;
+
+  TileCache();
+  ~TileCache();
+
+  // once a frame, before drawing. Takes in what the last composite asked
+  // for, drops every tile once the camera or the fractal changed, and
+  // otherwise marches the most needed of the missing ones. Tiles only go
+  // as coarse as `baseSize`, below that the layers suffice, and march
+  // with `mapIterCount` iterations
+  void update(camera &cam, std::shared_ptr<Program> &mandelShader, MandelRenderer &mandel, int mapIterCount, int baseSize);
+  // binds the page table and atlas to `firstUnit` and the one after, and
+  // the request buffers, for the composite shader. False when there are
+  // no tiles to show, as from a still or moved camera
+  bool bind(std::shared_ptr<Program> &compositeShader, int firstUnit);
+
+  int residentCount();
+  int slotCount();
+  // tiles asked for and not in yet
+  int waitingCount();
+  // whether the last requests read back asked for nothing that isn't in,
+  // or nothing more that could come in. Until then a still view has tiles
+  // left to march, even while none are waiting between request rounds
+  bool settled();
+  size_t memoryUsage();
+  // levels of tiles there are, the finest first
+  int levelCount();
+
+private:
+  GLuint atlas = 0, atlasFramebuf = 0, pageTable = 0;
+  // the composite's requests: a count and a list of tile indices, and a
+  // flag per tile so each only gets listed once
+  GLuint requestBuf = 0, flagBuf = 0;
+  int slotsPerSide = 0, levels = 0;
+  // what the storage above was made for
+  int builtSize = 0, builtBase = 0;
+  float builtBudget = 0.f;
+
+  // the tile in each slot, and the slot of each tile, -1 for none
+  std::vector<int> slotTile;
+  std::vector<int> tileSlot;
+  // the frame each slot's tile was last asked for
+  std::vector<long> lastUsed;
+  std::vector<int> waiting;
+  long frame = 0;
+  bool drained = false;
+
+  // where the resident tiles were marched from
+  bool captured = false;
+  glm::dvec3 capturePos;
+  double captureZoom = 0.;
+  int geometryRevision = -1, shadingRevision = -1;
+
+  void allocate(int baseSize);
+  void release();
+  // empties every slot
+  void flush();
+  // tiles along each side of a face at `level`
+  int tilesPerSide(int level);
+  // where the tiles of `level` start in the flat index over all levels,
+  // and the end of it past the last one
+  int levelOffset(int level);
+  void decode(int index, int &level, int &face, int &x, int &y);
+  // points the page table entry of tile `index` at `slot`, -1 for none
+  void setEntry(int index, int slot);
+  // a free slot, or the least recently asked for one not asked for this
+  // frame, emptied. -1 when every slot is in use this frame
+  int takeSlot();
+  // the tile indices the last composite asked for, clearing its requests
+  std::vector<int> readRequests();
+};
+
+#endif
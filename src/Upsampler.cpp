@@ -0,0 +1,140 @@
+#include "Upsampler.h"
+
+#include <iostream>
+#include <algorithm>
+
+// for the unit plane
+#include "MandelRenderer.h"
+
+void Upsampler::init(const std::string &resourceDirectory)
+{
+  upsampleShader = std::make_shared<Program>();
+  upsampleShader->setVerbose(true);
+  upsampleShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/upsample.fs");
+  if (!upsampleShader->init())
+  {
+    std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+    exit(1);
+  }
+  upsampleShader->addAttribute("vertPos");
+  upsampleShader->addUniform("lowColor");
+  upsampleShader->addUniform("lowDepth");
+  upsampleShader->addUniform("guideDepth");
+  upsampleShader->addUniform("lowResolution");
+  upsampleShader->addUniform("resolution");
+  upsampleShader->addUniform("depthSigma");
+  upsampleShader->addUniform("outputDepthBuffer");
+  upsampleShader->addUniform("writeDepth");
+}
+
+Upsampler::~Upsampler()
+{
+  if(lowFramebuf)
+  {
+    glDeleteTextures(1, &lowColorTex);
+    glDeleteTextures(1, &lowDepthTex);
+    glDeleteFramebuffers(1, &lowFramebuf);
+  }
+  if(guideFramebuf)
+  {
+    glDeleteTextures(1, &guideTex);
+    glDeleteFramebuffers(1, &guideFramebuf);
+  }
+}
+
+void Upsampler::beginLow(glm::vec2 size)
+{
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  if(w > lowWidth || h > lowHeight)
+  {
+    if(lowFramebuf)
+    {
+      glDeleteTextures(1, &lowColorTex);
+      glDeleteTextures(1, &lowDepthTex);
+      glDeleteFramebuffers(1, &lowFramebuf);
+    }
+    lowWidth = std::max(w, lowWidth);
+    lowHeight = std::max(h, lowHeight);
+    
+    glGenTextures(1, &lowColorTex);
+    glGenTextures(1, &lowDepthTex);
+    glGenFramebuffers(1, &lowFramebuf);
+    
+    glBindTexture(GL_TEXTURE_2D, lowColorTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, lowWidth, lowHeight);
+    glBindTexture(GL_TEXTURE_2D, lowDepthTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, lowWidth, lowHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuf);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, lowColorTex, 0);
+  }
+  
+  lowSize = size;
+  glBindFramebuffer(GL_FRAMEBUFFER, lowFramebuf);
+}
+
+GLuint Upsampler::getLowDepthBuf()
+{
+  return lowDepthTex;
+}
+
+void Upsampler::beginGuide(glm::vec2 size)
+{
+  int w = static_cast<int>(size.x), h = static_cast<int>(size.y);
+  if(w > guideWidth || h > guideHeight)
+  {
+    if(guideFramebuf)
+    {
+      glDeleteTextures(1, &guideTex);
+      glDeleteFramebuffers(1, &guideFramebuf);
+    }
+    guideWidth = std::max(w, guideWidth);
+    guideHeight = std::max(h, guideHeight);
+    
+    glGenTextures(1, &guideTex);
+    glGenFramebuffers(1, &guideFramebuf);
+    
+    glBindTexture(GL_TEXTURE_2D, guideTex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, guideWidth, guideHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, guideFramebuf);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, guideTex, 0);
+  }
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, guideFramebuf);
+}
+
+void Upsampler::resolve(glm::vec2 size, GLuint outputDepthBuf, int direction)
+{
+  // the low resolution depths were written through image stores
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glViewport(0, 0, size.x, size.y);
+  
+  upsampleShader->bind();
+  
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, lowColorTex);
+  glUniform1i(upsampleShader->getUniform("lowColor"), 0);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, lowDepthTex);
+  glUniform1i(upsampleShader->getUniform("lowDepth"), 1);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, guideTex);
+  glUniform1i(upsampleShader->getUniform("guideDepth"), 2);
+  glActiveTexture(GL_TEXTURE0);
+  
+  glBindImageTexture(1, outputDepthBuf, 0, GL_FALSE, direction, GL_WRITE_ONLY, GL_R32F);
+  glUniform1i(upsampleShader->getUniform("outputDepthBuffer"), 1);
+  glUniform1i(upsampleShader->getUniform("writeDepth"), outputDepthBuf != 0);
+  
+  glUniform2f(upsampleShader->getUniform("lowResolution"), lowSize.x, lowSize.y);
+  glUniform2f(upsampleShader->getUniform("resolution"), size.x, size.y);
+  glUniform1f(upsampleShader->getUniform("depthSigma"), depth_sigma);
+  
+  glBindVertexArray(MandelRenderer::VertexArrayUnitPlane);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  
+  upsampleShader->unbind();
+}
@@ -0,0 +1,41 @@
+#ifndef __UPSAMPLER_H
+#define __UPSAMPLER_H
+
+#include <memory>
+#include <string>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include "Program.h"
+
+// Edge aware upsampling of a reduced resolution march. The low resolution
+// color gets filtered with a joint bilateral filter, guided by a cheap
+// full resolution depth-only march, so silhouettes stay sharp.
+// Targets only ever grow, and get drawn into partially.
+class Upsampler
+{
+  GLuint lowFramebuf = 0, lowColorTex = 0, lowDepthTex = 0;
+  int lowWidth = 0, lowHeight = 0;
+  GLuint guideFramebuf = 0, guideTex = 0;
+  int guideWidth = 0, guideHeight = 0;
+  glm::vec2 lowSize;
+  std::shared_ptr<Program> upsampleShader;
+public:
+  // how different, relative to the guide, a depth may be and still blend
+  float depth_sigma = .1f;
+  
+  void init(const std::string &resourceDirectory);
+  ~Upsampler();
+  
+  // binds the low resolution target, the march writes its depths into
+  // `getLowDepthBuf`
+  void beginLow(glm::vec2 size);
+  GLuint getLowDepthBuf();
+  // binds the full resolution target for the depth-only guide march
+  void beginGuide(glm::vec2 size);
+  
+  // filters the low resolution march up to `size` into the bound
+  // framebuffer, and into layer `direction` of `outputDepthBuf` when set
+  void resolve(glm::vec2 size, GLuint outputDepthBuf, int direction);
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "glm/vec4.hpp"
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "FixedPoint.h"
 
 
 
@@ -19,23 +20,52 @@
 class camera
 {
 public:
-	glm::vec3 pos;
+	// the camera is a reference point, in fractal space and in fixed point, and
+	// its offset from there in world units. Moving and zooming only change
+	// the offset, which gets folded into the reference once it grows past
+	// `rebase_distance`, so zooms scale about the reference rather than
+	// about the fractal's origin
+	FixedVec3<8> reference;
+	glm::vec3 offset;
+	const float rebase_distance = 1.f;
 	double pitch;
 	double yaw;
 	
-	float zoomLevel = 1.0;
+	double zoomLevel = 1.0;
 	
 	float velocityFactor = 1.0;
 	
-	const float scaling_rate = 1.0 + 2e-2;
+	const double scaling_rate = 1.0 + 2e-2;
 	int w, a, s, d, q, e;
 	camera()
 	{
 		w = a = s = d = q = e = 0;
-		pos = glm::vec3(0, 0, 0);
+		offset = glm::vec3(0, 0, 0);
 		pitch = yaw = 0.;
 	}
 	
+	// in world units, where the fractal is scaled up by `zoomLevel`
+	glm::dvec3 position()
+	{
+	  return reference.toDouble()*zoomLevel + glm::dvec3(offset);
+	}
+	
+	void setPosition(glm::dvec3 p)
+	{
+	  reference = FixedVec3<8>(p/zoomLevel);
+	  offset = glm::vec3(0, 0, 0);
+	}
+	
+	// moves the reference onto the camera once it has drifted far enough
+	void rebase()
+	{
+	  if(glm::length(offset) > rebase_distance)
+	  {
+	    reference = reference + glm::dvec3(offset)/zoomLevel;
+	    offset = glm::vec3(0, 0, 0);
+	  }
+	}
+	
 	bool anyButtonPressed()
 	{
 	  return w || a || s || d || q || e;
@@ -52,9 +82,10 @@ public:
 	  yaw = glm::mod(yaw + dyaw,2*glm::pi<double>());
 	}
 	
-	void translate(glm::vec3 offset)
+	void translate(glm::vec3 delta)
 	{
-	  pos += offset;
+	  offset += delta;
+	  rebase();
 	}
 	
 	glm::vec3 getForward()
@@ -79,7 +110,8 @@ public:
 	
 	glm::mat4 getView()
 	{
-		return glm::lookAt(pos, (pos) + getForward(), getUp());
+		// only the orientation, positions are passed to the shaders separately
+		return glm::lookAt(glm::vec3(0), getForward(), getUp());
   }
   
   glm::vec3 xMovement()
@@ -103,19 +135,18 @@ public:
 		float xVel = 0;
 		
 		const float moveConst = .01;
+		// the camera stays where it is in fractal space, the world around it
+		// scales about the reference
 		if (q == 1)
 		{
 			zoomLevel *= scaling_rate;
-			pos *= scaling_rate;
+			offset *= static_cast<float>(scaling_rate);
 		}
 		if (e == 1)
 		{
-			zoomLevel = glm::max(1.f, zoomLevel/scaling_rate);
-			// only move us back in if the zoomlevel is still decreasing
-			if (zoomLevel > 1.f + 1e-2)
-			{
-				pos /= scaling_rate;
-			}
+			double last = zoomLevel;
+			zoomLevel = glm::max(1.0, zoomLevel/scaling_rate);
+			offset *= static_cast<float>(zoomLevel/last);
 		}
 		
 		if (w == 1)
@@ -134,8 +165,9 @@ public:
 			rot.y -= 0.01;
 	  */
 
-		pos += velocityFactor*xVel*xMovement();
-		pos += velocityFactor*zVel*zMovement();
+		offset += velocityFactor*xVel*xMovement();
+		offset += velocityFactor*zVel*zMovement();
+		rebase();
 
 		return getView();
 	}
@@ -25,6 +25,10 @@
 #include "camera.h"
 #include "MarchingLayer.h"
 #include "MarchingManager.h"
+#include "ResolutionScaler.h"
+#include "Refiner.h"
+#include "LodController.h"
+#include "ReferenceOrbits.h"
 
 #include "imgui_impl_glfw_gl3.h"
 
@@ -48,6 +52,7 @@ using namespace glm;
 #define FRAMEHEIGHT 480
 #endif
 
+// the onion layers' faces, see TileCache for finer ones where looked at
 #define BOXTEXSIZE 256
 
 class Application : public EventCallbacks
@@ -59,8 +64,12 @@ public:
 
   // Our shader program
   std::shared_ptr<Program> mandelshader;
+  // the same one in emulated and in native double precision, for deep zooms
+  std::shared_ptr<Program> mandelshaderDF;
+  std::shared_ptr<Program> mandelshader64;
   
-  std::shared_ptr<Program> ccSphereshader;
+  // draws the onion layers to the screen
+  std::shared_ptr<Program> compositeShader;
 
   //camera
   camera mycam;
@@ -69,6 +78,16 @@ public:
 
   std::shared_ptr<MarchingManager> marcher;
   
+  ResolutionScaler resScaler;
+  Refiner refiner;
+  LodController lod;
+  ReferenceOrbits orbits;
+  // the last orbit finished for the camera's reference point
+  std::shared_ptr<const ReferenceOrbits::Orbit> referenceOrbit;
+  // set when nothing changes and there is no refining left to do either,
+  // so the main loop can wait on input
+  bool resting = false;
+  
   GLuint feedbackBuf, queryObject;
   
   bool showHUD = false;
@@ -80,42 +99,118 @@ public:
   bool cubemode = false;
   bool freezeRender = false;
   
+  // side by side stereo, with the eyes `ipd` apart in world space
+  bool stereo = false;
+  float ipd = 0.064f;
+  std::array<GLuint, 2> eyeFramebufs, eyeTextures;
+  int eyeWidth = 0, eyeHeight = 0;
+  
   string shaderLoc;
   
   GLuint commonSkyStencil;
   
   std::chrono::steady_clock::time_point last_update;
   
-  void addShaderAttributes()
+  void addShaderAttributes(std::shared_ptr<Program> &shader)
   {
-    mandelshader->addAttribute("vertPos");
-    mandelshader->addUniform("inputDepthBuffer");
-    mandelshader->addUniform("outputDepthBuffer");
-    mandelshader->addUniform("resolution");
-    mandelshader->addUniform("view");
-    mandelshader->addUniform("camOrigin");
-    mandelshader->addUniform("clearColor");
-    mandelshader->addUniform("yColor");
-    mandelshader->addUniform("zColor");
-    mandelshader->addUniform("wColor");
-    mandelshader->addUniform("diffc1");
-    mandelshader->addUniform("diffc2");
-    mandelshader->addUniform("diffc3");
-    mandelshader->addUniform("intersectThreshold");
-    mandelshader->addUniform("intersectStepCount");
-    mandelshader->addUniform("intersectStepFactor");
-    mandelshader->addUniform("zoomLevel");
-    mandelshader->addUniform("modulo");
-    mandelshader->addUniform("fle");
-    mandelshader->addUniform("exhaust");
-    mandelshader->addUniform("mapIterCount");
-    mandelshader->addUniform("startOffset");
-    mandelshader->addUniform("bulbXfrm");
-	mandelshader->addUniform("time");
-	mandelshader->addUniform("juliaFactor");
-	mandelshader->addUniform("juliaPoint");
-	mandelshader->addUniform("movingJulia");
-	mandelshader->addUniform("doFog");
+    shader->addAttribute("vertPos");
+    shader->addUniform("inputDepthBuffer");
+    shader->addUniform("outputDepthBuffer");
+    shader->addUniform("writeDepth");
+    shader->addUniform("resolution");
+    shader->addUniform("view");
+    shader->addUniform("camOrigin");
+    shader->addUniform("boundsCenter");
+    shader->addUniform("originHi");
+    shader->addUniform("originLo");
+    shader->addUniform("clearColor");
+    shader->addUniform("yColor");
+    shader->addUniform("zColor");
+    shader->addUniform("wColor");
+    shader->addUniform("diffc1");
+    shader->addUniform("diffc2");
+    shader->addUniform("diffc3");
+    shader->addUniform("intersectThreshold");
+    shader->addUniform("intersectStepCount");
+    shader->addUniform("intersectStepFactor");
+    shader->addUniform("zoomLevel");
+    shader->addUniform("modulo");
+    shader->addUniform("fle");
+    shader->addUniform("exhaust");
+    shader->addUniform("mapIterCount");
+    shader->addUniform("startOffset");
+    shader->addUniform("bulbXfrm");
+	shader->addUniform("time");
+	shader->addUniform("juliaFactor");
+	shader->addUniform("juliaPoint");
+	shader->addUniform("movingJulia");
+	shader->addUniform("doFog");
+	shader->addUniform("foveated");
+	shader->addUniform("bufferResolution");
+	shader->addUniform("gazePoint");
+	shader->addUniform("gazeDir");
+	shader->addUniform("foveaDensity");
+	shader->addUniform("foveaStepFalloff");
+	shader->addUniform("foveaIterFalloff");
+	shader->addUniform("collectStats");
+	shader->addUniform("nextPass");
+	shader->addUniform("continueRays");
+	shader->addUniform("bandFar");
+	shader->addUniform("depthLogRange");
+	shader->addUniform("octahedral");
+	shader->addUniform("depthOnly");
+	shader->addUniform("guideIterDrop");
+	shader->addUniform("interleave");
+	shader->addUniform("interleavePhase");
+	shader->addUniform("jitter");
+	shader->addUniform("iterBoost");
+	shader->addUniform("shadowSteps");
+	shader->addUniform("shadowSharpness");
+	shader->addUniform("footprintBias");
+	shader->addUniform("seedBuffer");
+	shader->addUniform("seeded");
+	shader->addUniform("seedFraction");
+	shader->addUniform("writeGBuffer");
+	shader->addUniform("shadeOnly");
+	shader->addUniform("gbufferNormal");
+	shader->addUniform("gbufferMaterial");
+	shader->addUniform("gbufferDepth");
+  }
+
+  // the march shader, with `precision` defined for the deep zoom variants,
+  // and marching all cube faces at once when `layered`, into log packed
+  // depths when `packed` as well. Null when it fails to compile
+  std::shared_ptr<Program> makeMandelShader(const std::string &precision = "", bool layered = false, bool packed = false)
+  {
+    std::shared_ptr<Program> shader = make_shared<Program>();
+    shader->setVerbose(true);
+    if(!precision.empty())
+      shader->addDefine(precision);
+    if(packed)
+      shader->addDefine("PACKED_DEPTH");
+    if(layered)
+    {
+      shader->addDefine("LAYERED_FACES");
+      shader->setShaderNames(shaderLoc + "/passthru.vs", shaderLoc + "/IQ_mandelbulb_derivative.fs", shaderLoc + "/faces.gs");
+    }
+    else
+      shader->setShaderNames(shaderLoc + "/passthru.vs", shaderLoc + "/IQ_mandelbulb_derivative.fs");
+    if(!shader->init())
+      return nullptr;
+    addShaderAttributes(shader);
+    return shader;
+  }
+  
+  // layered versions of the march programs there are, and the ones of
+  // those writing log packed depths
+  void makeLayeredShaders()
+  {
+    mrender.layeredPrograms[MandelRenderer::PRECISION_FLOAT] = makeMandelShader("", true);
+    mrender.layeredPrograms[MandelRenderer::PRECISION_DF64] = mandelshaderDF ? makeMandelShader("DF64_PRECISION", true) : nullptr;
+    mrender.layeredPrograms[MandelRenderer::PRECISION_FP64] = mandelshader64 ? makeMandelShader("DOUBLE_PRECISION", true) : nullptr;
+    mrender.packedPrograms[MandelRenderer::PRECISION_FLOAT] = makeMandelShader("", true, true);
+    mrender.packedPrograms[MandelRenderer::PRECISION_DF64] = mandelshaderDF ? makeMandelShader("DF64_PRECISION", true, true) : nullptr;
+    mrender.packedPrograms[MandelRenderer::PRECISION_FP64] = mandelshader64 ? makeMandelShader("DOUBLE_PRECISION", true, true) : nullptr;
   }
 
   void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -193,9 +288,9 @@ public:
     }
     if (key == GLFW_KEY_O && action == GLFW_PRESS)
     {
-      mycam.pos = vec3(0, 0, -2);
+      mycam.zoomLevel = 1.;
+      mycam.setPosition(dvec3(0, 0, -2));
       mycam.pitch = mycam.yaw = 0;
-      mycam.zoomLevel = 1.f;
     }
     if (key == GLFW_KEY_C && action == GLFW_PRESS)
     {
@@ -205,6 +300,10 @@ public:
     {
       freezeRender = !freezeRender;
     }
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+    {
+      stereo = !stereo;
+    }
     if (key == GLFW_KEY_H && action == GLFW_PRESS)
     {
       noImgui = !noImgui;
@@ -213,19 +312,20 @@ public:
 		if (key == GLFW_KEY_R && action == GLFW_PRESS)
 		{
 			// reload shader
-			shared_ptr<Program> tmp = mandelshader;
-
-			mandelshader = make_shared<Program>();
-			mandelshader->setVerbose(true);
-			mandelshader->setShaderNames(shaderLoc + "/passthru.vs", shaderLoc + "/IQ_mandelbulb_derivative.fs");
-			if (!mandelshader->init())
+			// the deep zoom variants may fail on GPUs without their features
+			shared_ptr<Program> single = makeMandelShader();
+			if (!single)
 			{
 				std::cerr << "One or more shaders failed to compile... no change made!" << std::endl;
-				mandelshader = tmp;
 			}
 			else
 			{
-				addShaderAttributes();
+				mandelshader = single;
+				mandelshaderDF = makeMandelShader("DF64_PRECISION");
+				mandelshader64 = makeMandelShader("DOUBLE_PRECISION");
+				mrender.df64Program = mandelshaderDF;
+				mrender.fp64Program = mandelshader64;
+				makeLayeredShaders();
 			}
 		}
 		
@@ -306,59 +406,89 @@ public:
     marcher = make_shared<MarchingManager>(BOXTEXSIZE, BOXTEXSIZE);
 
     mrender.init();
+    mrender.foveation.init(resourceDirectory);
+    mrender.upsampler.init(resourceDirectory);
+    mrender.interleaver.init(resourceDirectory);
+    mrender.seeder.init(resourceDirectory);
+    refiner.init(resourceDirectory);
+    orbits.init();
+    resScaler.init();
     
-    mycam.pos = vec3(0, 0, -2);
+    mycam.setPosition(dvec3(0, 0, -2));
     mycam.pitch = mycam.yaw = 0;
 
-    mandelshader = make_shared<Program>();
-    mandelshader->setVerbose(true);
     //mandelshader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/showspace.fs");
     //mandelshader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/IQ_juliabulb_derivative.fs");
-    mandelshader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/IQ_mandelbulb_derivative.fs");
-    if (!mandelshader->init())
+    mandelshader = makeMandelShader();
+    if (!mandelshader)
     {
       std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
       exit(1);
     }
-    addShaderAttributes();
+    // without doubles on the GPU, deep zooms stop at what emulated ones reach
+    mandelshaderDF = makeMandelShader("DF64_PRECISION");
+    mandelshader64 = makeMandelShader("DOUBLE_PRECISION");
+    if (!mandelshaderDF && !mandelshader64)
+      std::cerr << "No extended precision march, deep zooms will break up" << std::endl;
+    mrender.df64Program = mandelshaderDF;
+    mrender.fp64Program = mandelshader64;
+    // without these the faces get marched one draw each
+    makeLayeredShaders();
     
-    ccSphereshader = make_shared<Program>();
-    ccSphereshader->setVerbose(true);
-    ccSphereshader->setShaderNames(resourceDirectory + "/ccsphere.vs", resourceDirectory + "/ccsphere.fs");
-    if (!ccSphereshader->init())
+    compositeShader = make_shared<Program>();
+    compositeShader->setVerbose(true);
+    compositeShader->setShaderNames(resourceDirectory + "/passthru.vs", resourceDirectory + "/composite.fs");
+    if (!compositeShader->init())
     {
       std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
       exit(1);
     }
-    ccSphereshader->addAttribute("vertNor");
-    ccSphereshader->addAttribute("vertBinorm");
-    ccSphereshader->addAttribute("vertTan");
-    ccSphereshader->addAttribute("vertPos");
-    ccSphereshader->addAttribute("vertTex");
-    ccSphereshader->addUniform("sphereMap");
-    ccSphereshader->addUniform("MVP");
+    compositeShader->addAttribute("vertPos");
+    compositeShader->addUniform("layerCount");
+    compositeShader->addUniform("colorMaps");
+    compositeShader->addUniform("depthMaps");
+    compositeShader->addUniform("packedDepth");
+    compositeShader->addUniform("depthLogRange");
+    compositeShader->addUniform("octahedral");
+    compositeShader->addUniform("reproject");
+    compositeShader->addUniform("eyeShift");
+    compositeShader->addUniform("captureScale");
+    compositeShader->addUniform("faceScale");
+    compositeShader->addUniform("layerPass");
+    compositeShader->addUniform("tiled");
+    compositeShader->addUniform("virtualSize");
+    compositeShader->addUniform("tileSize");
+    compositeShader->addUniform("tileLevels");
+    compositeShader->addUniform("pageTable");
+    compositeShader->addUniform("tileAtlas");
+    compositeShader->addUniform("atlasSlots");
+    compositeShader->addUniform("maxTileRequests");
+    compositeShader->addUniform("resolution");
+    compositeShader->addUniform("camRight");
+    compositeShader->addUniform("camUp");
+    compositeShader->addUniform("camForward");
   }
 
   void initGeom(const std::string& resourceDirectory)
   {
     glGenTransformFeedbacks(1, &feedbackBuf);
     glGenQueries(1, &queryObject);
-
-    // prep the common mesh
-    MarchingLayer::skybox_mesh.loadMesh(resourceDirectory + "/skybox2.obj");
-    MarchingLayer::skybox_mesh.resize();
-    MarchingLayer::skybox_mesh.init();
   }
   
   // maybe call it an "onionbox" later or smthn
-  void renderSkybox()
+  void renderSkybox(bool still)
   {
     int width, height;
     // for each direction, bind a frame buffer, set the view matrix appropriately, and render
     
+    // still frames can reuse the layers as they are
+    if(!freezeRender && !still)
+    {
+      marcher->redraw_if_needed(mycam, mandelshader, mrender);
+    }
     if(!freezeRender)
     {
-      marcher->redraw(mycam, mandelshader, mrender);
+      marcher->updateTiles(mycam, mandelshader, mrender);
     }
     // This binds the main screen
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -368,7 +498,83 @@ public:
     glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
     glViewport(0, 0, width, height);
     
-    marcher->draw(mycam, ccSphereshader);
+    marcher->draw(mycam, compositeShader, vec2(width, height));
+  }
+  
+  // (re)creates the offscreen targets each eye is rendered into
+  void createEyeTargets(int width, int height)
+  {
+    if(width == eyeWidth && height == eyeHeight)
+      return;
+    
+    if(eyeWidth)
+    {
+      glDeleteTextures(2, eyeTextures.data());
+      glDeleteFramebuffers(2, eyeFramebufs.data());
+    }
+    eyeWidth = width;
+    eyeHeight = height;
+    
+    glGenTextures(2, eyeTextures.data());
+    glGenFramebuffers(2, eyeFramebufs.data());
+    for(int i = 0; i < 2; i++)
+    {
+      glBindTexture(GL_TEXTURE_2D, eyeTextures[i]);
+      glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      
+      glBindFramebuffer(GL_FRAMEBUFFER, eyeFramebufs[i]);
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, eyeTextures[i], 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+  
+  // both eyes share one set of onion layers, which only gets marched once
+  void renderStereo(int width, int height)
+  {
+    int halfWidth = width/2;
+    createEyeTargets(halfWidth, height);
+    
+    if(cubemode && !freezeRender)
+    {
+      marcher->redraw_if_needed(mycam, mandelshader, mrender);
+    }
+    
+    // under dynamic resolution, each eye is drawn into a corner of its target
+    vec2 eyeSize = resScaler.scaledSize(vec2(halfWidth, height));
+    
+    for(int eye = 0; eye < 2; eye++)
+    {
+      vec3 eyeOffset = (eye == 0 ? -.5f : .5f)*ipd*mycam.getRight();
+      vec2 drawnSize = eyeSize;
+      
+      glBindFramebuffer(GL_FRAMEBUFFER, eyeFramebufs[eye]);
+      if(cubemode)
+      {
+        glClearColor(0.f, 0.f, 0.f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glViewport(0, 0, eyeSize.x, eyeSize.y);
+        marcher->drawEye(mycam, eyeOffset, eyeSize, compositeShader, mandelshader, mrender);
+      }
+      else if(resScaler.enabled && mrender.data.edge_upsample)
+      {
+        drawnSize = vec2(halfWidth, height);
+        mrender.render(mandelshader, mycam.position() + dvec3(eyeOffset), mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, drawnSize, true, resScaler.scale, eye + 1);
+      }
+      else
+      {
+        mrender.render(mandelshader, mycam.position() + dvec3(eyeOffset), mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, eyeSize, true, 1.f, eye + 1);
+      }
+      
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, eyeFramebufs[eye]);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+      glBlitFramebuffer(0, 0, drawnSize.x, drawnSize.y, eye*halfWidth, 0, (eye + 1)*halfWidth, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
   }
 
   void render()
@@ -379,25 +585,108 @@ public:
     auto update_delay = this_update - last_update;
     mycam.process(std::chrono::duration_cast<std::chrono::milliseconds>(update_delay).count()/1000.);
 	last_update = this_update;
-    if(cubemode)
+    
+    mrender.updateRevisions();
+    bool still = refiner.update(mycam, mrender, vec2(width, height));
+    // a still cube view keeps going until its requests come back with
+    // every tile in
+    resting = still && !stereo && (cubemode ? marcher->tiles.settled() : refiner.converged());
+    
+    // refined frames are slow on purpose, and shouldn't steer the scale
+    if(!still)
+      resScaler.beginFrame();
+    marcher->face_scale = resScaler.enabled ? resScaler.scale : 1.f;
+    
+    if(stereo)
+    {
+      renderStereo(width, height);
+    }
+    else if(cubemode)
     {
-      renderSkybox();
+      renderSkybox(still);
+    }
+    else if(still)
+    {
+      refineStill(width, height);
     }
     else
     {
       glBindFramebuffer(GL_FRAMEBUFFER, 0);
       glClearColor(0.f, 1.f, 0.f, 1.f);
       glClear(GL_COLOR_BUFFER_BIT);
-      mrender.render(mandelshader, mycam.pos, mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, vec2(width, height), true);
+      if(resScaler.enabled && mrender.data.edge_upsample)
+      {
+        mrender.render(mandelshader, mycam.position(), mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, vec2(width, height), true, resScaler.scale);
+      }
+      else if(resScaler.enabled)
+      {
+        vec2 internal = resScaler.bind(vec2(width, height));
+        mrender.render(mandelshader, mycam.position(), mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, internal, true);
+        resScaler.present(vec2(width, height), 0);
+      }
+      else
+      {
+        mrender.render(mandelshader, mycam.position(), mycam.getForward(), vec3(0, 1, 0), mycam.zoomLevel, vec2(width, height), true);
+      }
+    }
+    
+    if(!still)
+      resScaler.endFrame();
+  }
+  
+  // marches one more sample of a still frame, unless it already has all
+  // of them
+  void refineStill(int width, int height)
+  {
+    vec2 size(width, height);
+    if(!refiner.converged())
+    {
+      MandelRenderer::RenderData dat = refiner.nextSample(mrender.data);
+      dat.zoom_level = mycam.zoomLevel;
+      dat.exhaust = 1;
+      refiner.beginSample(size);
+      mrender.render(mandelshader, mycam.position(), mycam.getForward(), vec3(0, 1, 0), size, dat);
+      refiner.accumulate(size);
     }
+    refiner.present(size, 0);
   }
   
   void update()
   {
     // use "zoom level" to determine level of detail
-   // mrender.data.map_iter_count = static_cast<int>(4-(log(mycam.zoomLevel)));
-    //marcher->setDepth(static_cast<int>(4-(log(mycam.zoomLevel))));
+    if(lod.enabled)
+    {
+      int width, height;
+      glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+      lod.update(static_cast<float>(mycam.zoomLevel), static_cast<float>(height), mrender.data);
+      marcher->setDepth(lod.layers());
+    }
 	  mrender.data.time = glfwGetTime();
+    
+    if(orbits.enabled)
+    {
+      int width, height;
+      glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+      ReferenceOrbits::Params params;
+      params.modulo = mrender.data.modulo;
+      params.start_offset = mrender.data.map_start_offset;
+      params.julia_factor = mrender.data.juliaFactor;
+      // the shader's moving julia point, at this frame's time. Without any
+      // weight it leaves the orbit alone, and stays put for the cache
+      double t = mrender.data.time;
+      if(mrender.data.juliaMoves())
+        params.julia_point = glm::dvec3(.4*cos(.25*t + 1.), .2*sin(t + .2) + .7*sin(t*.33 + .5), .7*cos(t*.33 + .05));
+      else
+        params.julia_point = glm::dvec3(mrender.data.juliaPoint.x, mrender.data.juliaPoint.y, mrender.data.juliaPoint.z);
+      // as many iterations as the shader's footprint would take a pixel away
+      double width_at = 2./(std::max(height, 1)*mrender.data.fle)/mycam.zoomLevel;
+      double n = -std::log(width_at)/std::log(std::max(mrender.data.modulo, 2)) + mrender.data.footprint_bias;
+      params.iterations = glm::clamp(static_cast<int>(std::ceil(n)), mrender.data.map_iter_count, orbits.max_iterations);
+      params.bits = orbits.bits;
+      std::shared_ptr<const ReferenceOrbits::Orbit> orbit = orbits.request(mycam.reference, params);
+      if(orbit)
+        referenceOrbit = orbit;
+    }
   }
   
   void createCCStencil(int width, int height)
@@ -442,12 +731,42 @@ public:
       ImGui::ColorEdit3("diffuse 3", (float*)&mrender.data.diff3);
       
       ImGui::SliderFloat("mapping start offset", &mrender.data.map_start_offset, 0.002f, 30.f, "%.3f", 1.2f);
-      ImGui::SliderFloat("zoom level", &mycam.zoomLevel, 1e-20f, 1.f, "%.3f", 4.f);
-      ImGui::SliderFloat("intersect threshold", &mrender.data.intersect_threshold, 1e-20, 1e-1f, "%.3e", 1.5f);
-      ImGui::SliderInt("intersect step count", &mrender.data.intersect_step_count, 1, 1024);
+      float zoom = static_cast<float>(mycam.zoomLevel);
+      if(ImGui::SliderFloat("zoom level", &zoom, 1e-20f, 1.f, "%.3f", 4.f))
+        mycam.zoomLevel = zoom;
+      ImGui::Checkbox("Automatic level of detail", &lod.enabled);
+      if(lod.enabled)
+      {
+        ImGui::SliderFloat("detail quality", &lod.quality, .25f, 2.f);
+        ImGui::Text("%d iterations (%.2f), %d layers (%.2f), %d steps", mrender.data.map_iter_count, lod.iterationTarget(), lod.layers(), lod.layerTarget(), mrender.data.intersect_step_count);
+      }
+      else
+      {
+        ImGui::SliderFloat("intersect threshold", &mrender.data.intersect_threshold, 1e-20, 1e-1f, "%.3e", 1.5f);
+        ImGui::SliderInt("intersect step count", &mrender.data.intersect_step_count, 1, 1024);
+      }
       ImGui::SliderFloat("intersect step factor", &mrender.data.intersect_step_factor, 1e-20, 1.f, "%.3e", 1.5f);
       ImGui::SliderInt("Mandelbulb modulo", &mrender.data.modulo, 2, 32);
-      ImGui::SliderInt("Mandelbulb map iter count", &mrender.data.map_iter_count, 1, 32);
+      if(!lod.enabled)
+        ImGui::SliderInt("Mandelbulb map iter count", &mrender.data.map_iter_count, 1, 32);
+      ImGui::SliderFloat("iterations past the pixel footprint", &mrender.data.footprint_bias, -2.f, 4.f);
+      ImGui::Checkbox("Extended precision for deep zooms", (bool*)&mrender.data.extended_precision);
+      if(mrender.data.extended_precision)
+      {
+        const char *precisions[] = { "Marching in floats", "Marching in emulated doubles", "Marching in doubles" };
+        ImGui::Text("%s", precisions[mrender.marchPrecision()]);
+      }
+      ImGui::Checkbox("Reference orbit on the CPU", &orbits.enabled);
+      if(orbits.enabled)
+      {
+        int precision = orbits.bits > 128;
+        const char *widths[] = { "128 bit", "256 bit" };
+        if(ImGui::Combo("orbit precision", &precision, widths, 2))
+          orbits.bits = precision ? 256 : 128;
+        if(referenceOrbit)
+          ImGui::Text("distance %.3e (%.3e world), %d iterations%s", referenceOrbit->distance, referenceOrbit->distance*mycam.zoomLevel, static_cast<int>(referenceOrbit->points.size()) - 1, referenceOrbit->escaped ? ", escaped" : "");
+        ImGui::Text("%d orbits cached, %d pending", orbits.cached(), orbits.pending());
+      }
       ImGui::SliderFloat("fle", &mrender.data.fle, 0.1f, 15.f);
 	  ImGui::SliderFloat("julia Factor", &mrender.data.juliaFactor, 0.f, 1.f);
 	  ImGui::Checkbox("MovingJulia", (bool*)&mrender.data.movingJulia);
@@ -456,6 +775,141 @@ public:
 		  ImGui::SliderFloat3("Julia Point", (float*)&mrender.data.juliaPoint, -1., 1.);
 	  }
 	  ImGui::Checkbox("Do Fog", (bool*)&mrender.data.doFog);
+	  ImGui::Checkbox("Reproject onion layers", &marcher->reproject);
+	  if (marcher->reproject)
+	  {
+		  ImGui::SliderFloat("reprojection radius", &marcher->reproject_radius, 1e-3f, 0.5f, "%.3f", 2.f);
+	  }
+	  ImGui::Checkbox("Skip layers behind resolved ones", &marcher->skip_resolved);
+	  if (marcher->skip_resolved && marcher->getPassCount() > 0)
+	  {
+		  ImGui::Text("%d of %d layer passes marched, %d pixels left by the front one", marcher->marchedPasses(), marcher->getPassCount(), marcher->getUnresolvedCount(marcher->getDepth() - 1));
+	  }
+	  ImGui::SliderFloat("layer resolution falloff", &marcher->layer_scale_falloff, .25f, 1.f);
+	  ImGui::SliderFloat("least layer resolution", &marcher->min_layer_scale, .125f, 1.f);
+	  int mapping = marcher->octahedral;
+	  const char *mappings[] = { "Cube faces", "Equal area octahedron" };
+	  if (ImGui::Combo("layer mapping", &mapping, mappings, 2))
+		  marcher->octahedral = mapping != 0;
+	  double layerSteps = 0.;
+	  for (int i = 0; i < marcher->getDepth(); i++)
+		  layerSteps += marcher->getStepCount(i);
+	  ImGui::Text("%.0fk march steps over all layers", layerSteps/1000.);
+	  ImGui::Text("%.1f MB of onion layers, %.1f MB pooled", marcher->getMemoryUsage()/(1024.f*1024.f), marcher->getIdleMemory()/(1024.f*1024.f));
+	  if (ImGui::TreeNode("Detail tiles"))
+	  {
+		  ImGui::Checkbox("march detail tiles when still", &marcher->tiles.enabled);
+		  int sizeLog = static_cast<int>(std::log2(marcher->tiles.virtual_size));
+		  ImGui::SliderInt("face resolution, log2", &sizeLog, 9, 13);
+		  marcher->tiles.virtual_size = 1 << sizeLog;
+		  ImGui::SliderFloat("tile memory (MB)", &marcher->tiles.memory_budget, 4.f, 512.f, "%.0f", 2.f);
+		  ImGui::SliderInt("tiles per frame", &marcher->tiles.tiles_per_frame, 1, 64);
+		  if (marcher->tiles.enabled)
+		  {
+			  ImGui::Text("%d levels, %d of %d tiles in, %d waiting, %.1f MB", marcher->tiles.levelCount(), marcher->tiles.residentCount(), marcher->tiles.slotCount(), marcher->tiles.waitingCount(), marcher->tiles.memoryUsage()/(1024.f*1024.f));
+		  }
+		  ImGui::TreePop();
+	  }
+	  if (ImGui::TreeNode("Layer formats"))
+	  {
+		  // by name, from one of the pool's tables
+		  auto formatCombo = [](const char *label, GLenum &format, const std::vector<LayerPool::FormatInfo> &formats) {
+			  std::vector<const char *> names;
+			  int current = 0;
+			  for (int k = 0; k < static_cast<int>(formats.size()); k++)
+			  {
+				  names.push_back(formats[k].name);
+				  if (formats[k].format == format)
+					  current = k;
+			  }
+			  bool changed = ImGui::Combo(label, &current, names.data(), static_cast<int>(names.size()));
+			  format = formats[current].format;
+			  return changed;
+		  };
+		  int depth = marcher->getDepth();
+		  if (marcher->color_formats.empty())
+			  marcher->color_formats.push_back(GL_RGBA8);
+		  marcher->color_formats.resize(depth, marcher->color_formats.back());
+		  for (int i = 0; i < depth; i++)
+		  {
+			  int layer = depth - 1 - i;
+			  const LayerPool::Layout &layout = marcher->getLayout(layer);
+			  const LayerPool::FormatInfo &color = LayerPool::formatInfo(layout.color);
+			  ImGui::PushID(i);
+			  formatCombo("color", marcher->color_formats[i], LayerPool::colorFormats());
+			  // what the composite fetches of each texel
+			  ImGui::Text("layer %d, %dx%d, %d bytes a texel", layer + 1, layout.width, layout.height, color.bytes + LayerPool::formatInfo(layout.depth).bytes);
+			  if (color.error > 1.f)
+				  ImGui::TextColored(ImVec4(1.f, .8f, .2f, 1.f), "rounds by %.1f display steps, gradients will band", color.error);
+			  ImGui::PopID();
+		  }
+		  formatCombo("depth", marcher->depth_format, LayerPool::depthFormats());
+		  ImGui::Text("depths round by %.2g of their distance", LayerPool::formatInfo(marcher->depth_format).error);
+		  if (marcher->depthFellBack())
+			  ImGui::TextColored(ImVec4(1.f, .8f, .2f, 1.f), "stored as 32 bit floats, packed depths need plain layered marches within their range");
+		  ImGui::TreePop();
+	  }
+	  ImGui::Checkbox("Split layers by distance", &marcher->fit_layers);
+	  if (marcher->fit_layers)
+	  {
+		  ImGui::SliderInt("steps per layer", &marcher->steps_per_layer, 4, 256);
+		  ImGui::SliderFloat("band fit rate", &marcher->fit_rate, 0.f, 1.f);
+		  std::vector<float> bands = marcher->getBands();
+		  for (int i = 0; i < static_cast<int>(bands.size()); i++)
+		  {
+			  int layer = marcher->getDepth() - 1 - i;
+			  ImGui::Text("layer %d to %.3g, %.0fk steps", layer + 1, bands[i], marcher->getStepCount(layer)/1000.);
+		  }
+		  if (!bands.empty())
+			  ImGui::Text("layer 1 beyond, %.0fk steps", marcher->getStepCount(0)/1000.);
+	  }
+	  ImGui::Checkbox("Foveated", (bool*)&mrender.data.foveated);
+	  if (mrender.data.foveated)
+	  {
+		  ImGui::SliderFloat2("gaze point", (float*)&mrender.data.gaze, 0.f, 1.f);
+		  ImGui::SliderFloat("fovea density", &mrender.data.fovea_density, .1f, 1.f);
+		  ImGui::SliderFloat("fovea step falloff", &mrender.data.fovea_step_falloff, 0.f, 2.f);
+		  ImGui::SliderFloat("fovea iteration falloff", &mrender.data.fovea_iter_falloff, 0.f, 16.f);
+	  }
+	  ImGui::Checkbox("Dynamic resolution", &resScaler.enabled);
+	  if (resScaler.enabled)
+	  {
+		  float targetFps = 1000.f / resScaler.target_ms;
+		  if (ImGui::SliderFloat("target fps", &targetFps, 10.f, 144.f, "%.0f"))
+		  {
+			  resScaler.target_ms = 1000.f / targetFps;
+		  }
+		  ImGui::SliderFloat("minimum scale", &resScaler.min_scale, .1f, 1.f);
+		  ImGui::Checkbox("Edge aware upsampling", (bool*)&mrender.data.edge_upsample);
+		  if (mrender.data.edge_upsample)
+		  {
+			  ImGui::SliderFloat("edge depth tolerance", &mrender.upsampler.depth_sigma, .01f, 1.f);
+			  ImGui::SliderInt("edge march iterations dropped", &mrender.data.guide_iter_drop, 0, 8);
+		  }
+		  ImGui::Text("GPU %.2f ms, resolution scale %.2f", resScaler.last_gpu_ms, resScaler.scale);
+	  }
+	  ImGui::Checkbox("Deferred shading", (bool*)&mrender.data.deferred);
+	  ImGui::Checkbox("Seed rays from the last frame", (bool*)&mrender.data.temporal_seed);
+	  if (mrender.data.temporal_seed)
+	  {
+		  ImGui::SliderFloat("seed fraction", &mrender.data.seed_fraction, .5f, 1.f);
+	  }
+	  ImGui::Checkbox("Refine still frames", &refiner.enabled);
+	  if (refiner.enabled)
+	  {
+		  ImGui::SliderInt("refinement samples", &refiner.max_samples, 1, 256);
+		  ImGui::Text("%d/%d samples", refiner.sampleCount(), refiner.max_samples);
+	  }
+	  ImGui::Text("Pixels marched per frame");
+	  ImGui::RadioButton("all", &mrender.data.interleave, 1); ImGui::SameLine();
+	  ImGui::RadioButton("1/2", &mrender.data.interleave, 2); ImGui::SameLine();
+	  ImGui::RadioButton("1/4", &mrender.data.interleave, 4);
+	  ImGui::Checkbox("Stereo", &stereo);
+	  if (stereo)
+	  {
+		  ImGui::SliderFloat("eye separation", &ipd, 0.f, 0.5f, "%.3f", 2.f);
+		  ImGui::SliderFloat("per eye parallax limit (px)", &marcher->parallax_limit, 0.f, 64.f, "%.1f");
+	  }
       
       ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
     }
@@ -467,7 +921,7 @@ public:
       vec3 xforward = mycam.xMovement();
       vec3 zforward = mycam.zMovement();
       ImGui::LabelText("View Vector:", "X: %0.2f, Y: %0.2f, Z: %0.2f", viewdir.x, viewdir.y, viewdir.z);
-      ImGui::LabelText("View Position:", "X: %0.2f, Y: %0.2f, Z: %0.2f", mycam.pos.x, mycam.pos.y, mycam.pos.z);
+      ImGui::LabelText("View Position:", "X: %0.2f, Y: %0.2f, Z: %0.2f", mycam.position().x, mycam.position().y, mycam.position().z);
       ImGui::LabelText("X Forward:", "X: %0.2f, Y: %0.2f, Z: %0.2f", xforward.x, xforward.y, xforward.z);
       ImGui::LabelText("Z Forward:", "X: %0.2f, Y: %0.2f, Z: %0.2f", zforward.x, zforward.y, zforward.z);
       ImGui::LabelText("Theta:", "%0.2f pi", mycam.yaw / pi<float>());
@@ -492,7 +946,7 @@ public:
     
     if(ImGui::Begin("Position HUD", &showHUD, ImGuiWindowFlags_NoTitleBar|ImGuiWindowFlags_NoResize|ImGuiWindowFlags_AlwaysAutoResize|ImGuiWindowFlags_NoMove|ImGuiWindowFlags_NoSavedSettings|ImGuiWindowFlags_NoFocusOnAppearing|ImGuiWindowFlags_NoNav))
     {
-      ImGui::Text("Position: X: %0.2f, Y: %0.2f, Z: %0.2f", mycam.pos.x, mycam.pos.y, mycam.pos.z);
+      ImGui::Text("Position: X: %0.2f, Y: %0.2f, Z: %0.2f", mycam.position().x, mycam.position().y, mycam.position().z);
       
       ImGui::Text("Zoom Level:");
       ImGui::SameLine(); ImGui::ProgressBar(log(mycam.zoomLevel)/1e1);
@@ -581,8 +1035,12 @@ int main(int argc, char **argv)
     
     // Swap front and back buffers.
     glfwSwapBuffers(windowManager->getHandle());
-    // Poll for and process events.
-    glfwPollEvents();
+    // Poll for and process events, or wait on them when there's nothing
+    // left to draw
+    if(application->resting)
+      glfwWaitEventsTimeout(.1);
+    else
+      glfwPollEvents();
   }
 
   // Quit program.